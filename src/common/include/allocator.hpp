@@ -1,11 +1,19 @@
 #ifndef SQK_COMMON_ALLOCATOR_HPP_
 #define SQK_COMMON_ALLOCATOR_HPP_
 
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <cstdint>
+#include <mutex>
 #include <new>
-#include <stack>
+#include <numeric>
+#include <utility>
 
 #include "log.hpp"
+#include "mem_policy.hpp"
 #include "utilty.h"
 
 namespace sqk::common {
@@ -67,6 +75,11 @@ struct PoolAllocatable {
     // ) noexcept;
 };
 
+/**
+ * TLSF backed allocator, every thread allocate from its own pool grown by
+ * 2MB areas on demand, a block freed by another thread is handed back to
+ * its owning pool. see `tlsf_allocator.cc`.
+ */
 struct TlsfPoolAllocator: public PoolAllocatable<TlsfPoolAllocator> {
     void* operator new(std::size_t size);
     void* operator new[](std::size_t size);
@@ -76,10 +89,393 @@ struct TlsfPoolAllocator: public PoolAllocatable<TlsfPoolAllocator> {
     void operator delete[](void* ptr) noexcept;
     void operator delete(void* ptr, const std::nothrow_t&) noexcept;
     void operator delete[](void* ptr, const std::nothrow_t&) noexcept;
+
+    /**
+     * pages and node of the areas mapped from now on, set it before the
+     * workers start allocating.
+     */
+    static void set_mem_policy(const MemPolicy& policy) noexcept;
+
+    /* bytes mapped by the pools of every thread */
+    static std::size_t mapped() noexcept;
 };
 
 #define ROUNDUP(_x, _v) ((((~(_x)) + 1) & ((_v) - 1)) + (_x))
 
+struct SlabFreeNode {
+    SlabFreeNode* next_;
+};
+
+/* descriptor of one unit of a `SlabSegment` */
+struct SlabUnit {
+    uint16_t ind_;   /**< size class of the slab, or SPAN_CLASS */
+    uint16_t span_;  /**< units of the slab or span holding this unit */
+    uint16_t first_; /**< first unit of the slab or span */
+};
+
+/**
+ * 2MB aligned region carved into 4KB units, slabs take one or a few 64KB
+ * aligned pages of a single size class and larger blocks take a span of
+ * units. the header sit in unit 0 and is found from any block by masking
+ * the address, so blocks carry no header of their own.
+ *
+ * a huge segment is a dedicated mapping of one block too big for a
+ * segment, it is unmapped on free from any thread.
+ */
+struct SlabSegment {
+    static constexpr uint16_t SLAB_MAGIC = 0b1010101001010101;
+    static constexpr uint16_t SPAN_CLASS = UINT16_MAX;
+    static constexpr std::size_t SEGMENT_SHIFT = 21;
+    static constexpr std::size_t SEGMENT_SIZE = 1UL << SEGMENT_SHIFT;
+    static constexpr std::size_t UNIT_SHIFT = 12;
+    static constexpr std::size_t UNIT_SIZE = 1UL << UNIT_SHIFT;
+    static constexpr uint32_t UNITS = SEGMENT_SIZE >> UNIT_SHIFT;
+    static constexpr uint32_t PAGE_SHIFT = 4;
+    static constexpr uint32_t PAGE_UNITS = 1U << PAGE_SHIFT;
+    static constexpr std::size_t PAGE_SIZE = PAGE_UNITS * UNIT_SIZE;
+    static constexpr uint32_t PAGES = UNITS / PAGE_UNITS;
+
+    uint16_t magic_;
+    uint16_t owner_;
+    bool huge_;
+    std::size_t size_;     /**< size of the mapping */
+    SlabSegment* next_;    /**< next segment of the owner cache */
+    uint64_t used_[UNITS / 64];
+    uint16_t tally_[PAGES]; /**< scratch of `SlabPoolAllocator::trim` */
+    SlabUnit units_[UNITS];
+
+    static inline std::atomic<std::size_t> mapped_;
+    static inline MemPolicy policy_;
+
+    static SlabSegment* of(void* ptr) noexcept {
+        return reinterpret_cast<SlabSegment*>(
+            reinterpret_cast<uintptr_t>(ptr) & ~(SEGMENT_SIZE - 1)
+        );
+    }
+
+    uint32_t index_of(void* ptr) const noexcept {
+        return (reinterpret_cast<uintptr_t>(ptr)
+                - reinterpret_cast<uintptr_t>(this))
+            >> UNIT_SHIFT;
+    }
+
+    uint8_t* unit_addr(uint32_t i) noexcept {
+        return reinterpret_cast<uint8_t*>(this) + (std::size_t(i) << UNIT_SHIFT);
+    }
+
+    /**
+     * map `size` bytes aligned to SEGMENT_SIZE following `policy_`, unit 0
+     * already in use
+     */
+    static SlabSegment* map(std::size_t size, uint16_t owner) noexcept {
+        size = ROUNDUP(size, UNIT_SIZE);
+        auto base = policy_.map(size, SEGMENT_SIZE);
+        if (unlikely(base == nullptr)) {
+            return nullptr;
+        }
+        mapped_.fetch_add(size, std::memory_order_relaxed);
+        auto segment = static_cast<SlabSegment*>(base);
+        segment->magic_ = SLAB_MAGIC;
+        segment->owner_ = owner;
+        segment->huge_ = false;
+        segment->size_ = size;
+        segment->used_[0] = 1;
+        return segment;
+    }
+
+    static void unmap(SlabSegment* segment) noexcept {
+        mapped_.fetch_sub(segment->size_, std::memory_order_relaxed);
+        MemPolicy::unmap(segment, segment->size_);
+    }
+
+    bool empty() const noexcept {
+        if (used_[0] != 1) {
+            return false;
+        }
+        for (uint32_t i = 1; i < UNITS / 64; i++) {
+            if (used_[i]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /* first `n` free 64KB aligned pages, return their first unit or 0 */
+    uint32_t alloc_pages(uint32_t n) noexcept {
+        uint32_t run = 0;
+        for (uint32_t i = 1; i < PAGES; i++) {
+            auto u = i << PAGE_SHIFT;
+            run = ((used_[u / 64] >> (u % 64)) & 0xffff) ? 0 : run + 1;
+            if (run == n) {
+                uint32_t first = (i + 1 - n) << PAGE_SHIFT;
+                this->mark_units(first, n << PAGE_SHIFT, true);
+                return first;
+            }
+        }
+        return 0;
+    }
+
+    /* first fit run of `n` free units, return 0 if there is none */
+    uint32_t alloc_units(uint32_t n) noexcept {
+        uint32_t run = 0;
+        for (uint32_t i = 1; i < UNITS; i++) {
+            if (used_[i / 64] == UINT64_MAX) {
+                run = 0;
+                i += 63 - i % 64;
+                continue;
+            }
+            run = (used_[i / 64] >> (i % 64)) & 1 ? 0 : run + 1;
+            if (run == n) {
+                uint32_t first = i + 1 - n;
+                this->mark_units(first, n, true);
+                return first;
+            }
+        }
+        return 0;
+    }
+
+    void free_units(uint32_t first, uint32_t n) noexcept {
+        this->mark_units(first, n, false);
+    }
+
+    /* give the memory of `n` units back to the system, keep the mapping */
+    void release_units(uint32_t first, uint32_t n) noexcept {
+        madvise(unit_addr(first), std::size_t(n) << UNIT_SHIFT, MADV_DONTNEED);
+    }
+
+  private:
+    void mark_units(uint32_t first, uint32_t n, bool used) noexcept {
+        for (uint32_t i = first; i < first + n; i++) {
+            if (used) {
+                used_[i / 64] |= 1UL << (i % 64);
+            } else {
+                used_[i / 64] &= ~(1UL << (i % 64));
+            }
+        }
+    }
+};
+
+static_assert(sizeof(SlabSegment) <= SlabSegment::UNIT_SIZE, "");
+static_assert(SlabSegment::PAGE_UNITS == 16, "alloc_pages test 16 bits");
+
+/**
+ * size classes of `SlabPoolAllocator`: 8 byte steps up to 128B, then 4
+ * classes per power of two up to 256KB, so a block never waste more than
+ * 25% of its size. the slab of a class is one 64KB page, or for classes
+ * over 16KB the fewest pages the blocks fill exactly.
+ */
+struct SlabSizeClass {
+    static constexpr std::size_t LINEAR_MAX = 128;
+    static constexpr uint32_t LINEAR_CLASSES = LINEAR_MAX >> 3;
+    static constexpr uint32_t STEPS_SHIFT = 2;
+    static constexpr uint32_t MAX_SHIFT = 18;
+    static constexpr std::size_t MAX_SIZE = 1UL << MAX_SHIFT;
+    static constexpr uint32_t COUNT =
+        LINEAR_CLASSES + ((MAX_SHIFT - 7) << STEPS_SHIFT) + 1;
+
+    /* class of `size`, 0 < size <= MAX_SIZE */
+    static constexpr uint32_t index(std::size_t size) noexcept {
+        if (likely(size <= LINEAR_MAX)) {
+            return (size + 7) >> 3;
+        }
+        uint32_t k = 63 - __builtin_clzl(size - 1);
+        uint32_t shift = k - STEPS_SHIFT;
+        return LINEAR_CLASSES + ((k - 7) << STEPS_SHIFT)
+            + ((size - (1UL << k) + (1UL << shift) - 1) >> shift);
+    }
+
+    static constexpr std::size_t size(uint32_t ind) noexcept {
+        if (ind <= LINEAR_CLASSES) {
+            return std::size_t(ind) << 3;
+        }
+        uint32_t i = ind - LINEAR_CLASSES - 1;
+        uint32_t k = 7 + (i >> STEPS_SHIFT);
+        return (1UL << k) + (((i & 3) + 1UL) << (k - STEPS_SHIFT));
+    }
+
+    static constexpr uint32_t pages(uint32_t ind) noexcept {
+        auto sz = size(ind);
+        if (sz <= SlabSegment::PAGE_SIZE / 4) {
+            return 1;
+        }
+        return sz / std::gcd(sz, SlabSegment::PAGE_SIZE);
+    }
+};
+
+static_assert(SlabSizeClass::index(SlabSizeClass::MAX_SIZE) + 1 == SlabSizeClass::COUNT, "");
+static_assert(SlabSizeClass::size(SlabSizeClass::index(129)) == 160, "");
+static_assert(SlabSizeClass::size(SlabSizeClass::COUNT - 1) == SlabSizeClass::MAX_SIZE, "");
+static_assert(SlabSizeClass::pages(SlabSizeClass::index(56UL << 10)) == 7, "");
+
+/**
+ * bump-carved slab page and intrusive freelist of one size class, `count_`
+ * is only written by the owner and may be read by `SlabPoolAllocator::stats`
+ * from any thread.
+ */
+struct SlabBin {
+    SlabFreeNode* free_ {nullptr};
+    uint8_t* bump_ {nullptr};
+    uint8_t* end_ {nullptr};
+    std::atomic<uint32_t> count_ {0}; /**< blocks in `free_` */
+    uint32_t floor_ {0};              /**< `count_` after the last trim */
+
+    void add_count(int32_t n) noexcept {
+        count_.store(
+            count_.load(std::memory_order_relaxed) + n,
+            std::memory_order_relaxed
+        );
+    }
+};
+
+/**
+ * per-thread size-class cache of `SlabPoolAllocator`, owning the segments
+ * its pages are carved from. blocks freed by their owner go straight into
+ * `bins_`, blocks freed by any other thread are pushed onto the lock-free
+ * `remote_` list of the owner, and the owner take the whole list back in
+ * one exchange on its next allocation miss.
+ *
+ * caches are never freed: a cache whose thread exited is orphaned, with its
+ * segments, and keep collecting remote frees until a new thread adopt it.
+ */
+struct SlabThreadCache {
+    static constexpr uint32_t MAX_CLASS = 64;
+
+    explicit SlabThreadCache(uint16_t id) : id_(id) {}
+
+    void remote_free(void* ptr) noexcept {
+        auto node = static_cast<SlabFreeNode*>(ptr);
+        node->next_ = remote_.load(std::memory_order_relaxed);
+        while (!remote_.compare_exchange_weak(
+            node->next_,
+            node,
+            std::memory_order_release,
+            std::memory_order_relaxed
+        )) {}
+    }
+
+    bool has_remote() const noexcept {
+        return remote_.load(std::memory_order_relaxed) != nullptr;
+    }
+
+    /* detach the whole remote list, the caller free it locally */
+    SlabFreeNode* take_remote() noexcept {
+        return remote_.exchange(nullptr, std::memory_order_acquire);
+    }
+
+    /**
+     * free a block of one of our own segments, return its class, or
+     * MAX_CLASS for a span.
+     */
+    uint32_t free_local(void* ptr, SlabSegment* segment) noexcept {
+        auto i = segment->index_of(ptr);
+        auto& unit = segment->units_[i];
+        if (likely(unit.ind_ != SlabSegment::SPAN_CLASS)) {
+            auto& bin = bins_[unit.ind_];
+            auto node = static_cast<SlabFreeNode*>(ptr);
+            node->next_ = bin.free_;
+            bin.free_ = node;
+            bin.add_count(1);
+            return unit.ind_;
+        }
+        segment->free_units(i, unit.span_);
+        return MAX_CLASS;
+    }
+
+    /**
+     * take a slab of `n` units for class `ind`, or a span of `n` units, from
+     * the first segment that fit, then from the depot, then map a new
+     * segment.
+     */
+    uint8_t* alloc_units(uint32_t n, uint16_t ind) noexcept {
+        SlabSegment* segment = segments_;
+        uint32_t first = 0;
+        for (; segment; segment = segment->next_) {
+            if ((first = take_units(segment, n, ind))) {
+                break;
+            }
+        }
+        if (segment == nullptr) {
+            segment = depot_take(id_);
+            if (segment == nullptr) {
+                segment = SlabSegment::map(SlabSegment::SEGMENT_SIZE, id_);
+            }
+            if (unlikely(segment == nullptr)) {
+                return nullptr;
+            }
+            segment->next_ = segments_;
+            segments_ = segment;
+            first = take_units(segment, n, ind);
+        }
+        for (uint32_t i = first; i < first + n; i++) {
+            segment->units_[i] = {
+                ind,
+                static_cast<uint16_t>(n),
+                static_cast<uint16_t>(first),
+            };
+        }
+        return segment->unit_addr(first);
+    }
+
+    /**
+     * park an empty segment in the process wide depot for any thread to
+     * reuse, its memory is given back to the system, the depot hold at
+     * most `depot_limit_` segments and unmap the rest.
+     */
+    static void depot_put(SlabSegment* segment) noexcept {
+        segment->release_units(1, SlabSegment::UNITS - 1);
+        std::lock_guard guard(depot_lock_);
+        if (depot_count_ >= depot_limit_) {
+            SlabSegment::unmap(segment);
+            return;
+        }
+        segment->next_ = depot_;
+        depot_ = segment;
+        depot_count_++;
+    }
+
+    static SlabSegment* depot_take(uint16_t owner) noexcept {
+        std::lock_guard guard(depot_lock_);
+        auto segment = depot_;
+        if (segment) {
+            depot_ = segment->next_;
+            depot_count_--;
+            segment->owner_ = owner;
+        }
+        return segment;
+    }
+
+    const uint16_t id_;
+    bool orphaned_ {false};
+    SlabBin bins_[MAX_CLASS];
+    SlabSegment* segments_ {nullptr};
+    alignas(SQK_CACHE_LINESIZE) std::atomic<SlabFreeNode*> remote_ {nullptr};
+
+    static inline std::mutex depot_lock_;
+    static inline SlabSegment* depot_;
+    static inline uint32_t depot_count_;
+    static inline uint32_t depot_limit_ {4};
+
+  private:
+    static uint32_t take_units(SlabSegment* segment, uint32_t n, uint16_t ind) {
+        return ind == SlabSegment::SPAN_CLASS
+            ? segment->alloc_units(n)
+            : segment->alloc_pages(n >> SlabSegment::PAGE_SHIFT);
+    }
+};
+
+struct SlabStats {
+    std::size_t cached_[SlabThreadCache::MAX_CLASS]; /**< free bytes per class */
+    std::size_t mapped_; /**< bytes of segments mapped, depot included */
+
+    std::size_t cached() const noexcept {
+        std::size_t total = 0;
+        for (auto bytes : cached_) {
+            total += bytes;
+        }
+        return total;
+    }
+};
+
 struct SlabPoolAllocator: public PoolAllocatable<SlabPoolAllocator> {
     void* operator new(std::size_t size) {
         void *ptr;
@@ -89,73 +485,360 @@ struct SlabPoolAllocator: public PoolAllocatable<SlabPoolAllocator> {
         }
         return ptr;
     }
-    void* operator new[](std::size_t size) { return ::operator new[](size); }
+    void* operator new[](std::size_t size) {
+        return operator new(size);
+    }
     void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
         return slab_alloc(size);
     }
-    void* operator new[](std::size_t size, const std::nothrow_t& nothrow) noexcept { return ::operator new[](size, nothrow); }
+    void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+        return slab_alloc(size);
+    }
     void operator delete(void* ptr) noexcept {
         slab_dealloc(ptr);
     }
-    void operator delete[](void* ptr) noexcept { return ::operator delete[](ptr); }
+    void operator delete[](void* ptr) noexcept {
+        slab_dealloc(ptr);
+    }
     void operator delete(void* ptr, const std::nothrow_t&) noexcept {
         slab_dealloc(ptr);
     }
-    void operator delete[](void* ptr, const std::nothrow_t& nothrow) noexcept { return ::operator delete[](ptr, nothrow); }
+    void operator delete[](void* ptr, const std::nothrow_t&) noexcept {
+        slab_dealloc(ptr);
+    }
+
+    /**
+     * bytes class `ind` (see `SlabSizeClass::index`) may keep cached per
+     * thread before the free path trim it, pages whose blocks are all free
+     * then go back to the system. 1MB by default.
+     */
+    static void set_class_limit(uint32_t ind, std::size_t bytes) noexcept {
+        S_ASSERT(ind < SlabSizeClass::COUNT);
+        class_limit_[ind].store(bytes, std::memory_order_relaxed);
+    }
+
+    /* the same limit for every class */
+    static void set_class_limit(std::size_t bytes) noexcept {
+        for (auto& limit : class_limit_) {
+            limit.store(bytes, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * pages and node of the segments mapped from now on, set it before the
+     * workers start allocating. the depot may still hand a segment mapped
+     * under the previous policy to any thread.
+     */
+    static void set_mem_policy(const MemPolicy& policy) noexcept {
+        SlabSegment::policy_ = policy;
+    }
+
+    /* empty segments kept in the process wide depot, the rest is unmapped */
+    static void set_depot_limit(uint32_t segments) noexcept {
+        std::lock_guard guard(SlabThreadCache::depot_lock_);
+        SlabThreadCache::depot_limit_ = segments;
+    }
+
+    /**
+     * give the fully free pages of this thread's cache back to the system
+     * and its empty segments to the depot, return the bytes released. the
+     * scheduler call it before parking.
+     */
+    static std::size_t trim() noexcept {
+        auto cache = tcache_;
+        if (cache == nullptr) {
+            return 0;
+        }
+        if (cache->has_remote()) {
+            reclaim(cache);
+        }
+        std::size_t released = 0;
+        for (uint32_t ind = 1; ind < SlabSizeClass::COUNT; ind++) {
+            if (cache->bins_[ind].free_) {
+                released += trim_class(cache, ind);
+            }
+        }
+        SlabSegment** link = &cache->segments_;
+        while (*link) {
+            auto segment = *link;
+            if (segment->empty()) {
+                *link = segment->next_;
+                SlabThreadCache::depot_put(segment);
+            } else {
+                link = &segment->next_;
+            }
+        }
+        return released;
+    }
+
+    /* cached bytes of every thread, racy but never torn */
+    static SlabStats stats() noexcept {
+        SlabStats stats {};
+        auto n = ncaches_.load(std::memory_order_acquire);
+        for (uint32_t i = 0; i < n; i++) {
+            auto cache = caches_[i].load(std::memory_order_acquire);
+            for (uint32_t ind = 1; ind < SlabSizeClass::COUNT; ind++) {
+                stats.cached_[ind] += SlabSizeClass::size(ind)
+                    * cache->bins_[ind].count_.load(std::memory_order_relaxed);
+            }
+        }
+        stats.mapped_ = SlabSegment::mapped_.load(std::memory_order_relaxed);
+        return stats;
+    }
+
 private:
-    static constexpr uint16_t SLAB_MAGIC = 0b1010101001010101;
-    static constexpr uint32_t MAX_CLASS_SHIFT = 9;
-    struct SlabHeader {
-        std::size_t ind_: MAX_CLASS_SHIFT + 1;
-        std::size_t magic_: 16;
-    };
     static void *slab_alloc(std::size_t size) noexcept {
-        void* ptr;
-        auto rsize = roundup(size);
-        auto ind = size2ind(rsize);
+        auto cache = this_cache();
+        if (unlikely(cache == nullptr)) {
+            return huge_alloc(size);
+        }
+        if (unlikely(size > SlabSizeClass::MAX_SIZE)) {
+            return span_alloc(cache, size);
+        }
+        auto ind = SlabSizeClass::index(std::max(size, BASE_SIZE));
         // fast path
-        if (likely(ind < LOOKUP_MAX_CLASS && !tcache_[ind].empty())) {
-            ptr = tcache_[ind].top();
-            tcache_[ind].pop();
-        } else {
-            ptr = static_cast<uint8_t*>(::operator new(rsize + SLAB_OVERHEAD)) + SLAB_OVERHEAD;
-            SlabHeader* header = ptr2header(ptr);
-            header->ind_ = std::min(ind, LOOKUP_MAX_CLASS);
-#ifndef NDEBUG
-            header->magic_ = SLAB_MAGIC;
-#endif // !NDEBUG
+        auto& bin = cache->bins_[ind];
+        if (likely(bin.free_ != nullptr)) {
+            return pop(bin);
         }
-        return ptr;
+        return refill(cache, ind);
     }
 
     static void slab_dealloc(void* ptr) noexcept {
-        SlabHeader* header = ptr2header(ptr);
-        S_ASSERT(header->magic_ == SLAB_MAGIC);
-        auto ind = header->ind_;
-        if (likely(ind < LOOKUP_MAX_CLASS)) {
-            tcache_[ind].push(ptr);
+        auto segment = SlabSegment::of(ptr);
+        S_ASSERT(segment->magic_ == SlabSegment::SLAB_MAGIC);
+        if (unlikely(segment->huge_)) {
+            SlabSegment::unmap(segment);
+            return;
+        }
+        auto cache = tcache_;
+        if (likely(cache != nullptr && segment->owner_ == cache->id_)) {
+            auto ind = cache->free_local(ptr, segment);
+            if (likely(ind != SlabThreadCache::MAX_CLASS)
+                && unlikely(over_limit(cache->bins_[ind], ind))) {
+                trim_class(cache, ind);
+            }
         } else {
-            ::operator delete(header);
+            caches_[segment->owner_].load(std::memory_order_acquire)
+                ->remote_free(ptr);
+        }
+    }
+
+    static void* pop(SlabBin& bin) noexcept {
+        auto node = bin.free_;
+        bin.free_ = node->next_;
+        bin.add_count(-1);
+        return node;
+    }
+
+    /**
+     * the freelist of class `ind` is empty: reclaim remote frees, else carve
+     * from the current slab, else start a new slab.
+     */
+    static void* refill(SlabThreadCache* cache, uint32_t ind) noexcept {
+        auto& bin = cache->bins_[ind];
+        auto rsize = SlabSizeClass::size(ind);
+        bin.floor_ = 0;
+        if (cache->has_remote() && reclaim(cache, ind)) {
+            return pop(bin);
+        }
+        if (static_cast<std::size_t>(bin.end_ - bin.bump_) < rsize) {
+            auto pages = SlabSizeClass::pages(ind);
+            auto slab = cache->alloc_units(pages << SlabSegment::PAGE_SHIFT, ind);
+            if (unlikely(slab == nullptr)) {
+                return nullptr;
+            }
+            bin.bump_ = slab;
+            bin.end_ = slab + pages * SlabSegment::PAGE_SIZE;
+        }
+        void* ptr = bin.bump_;
+        bin.bump_ += rsize;
+        return ptr;
+    }
+
+    static void* span_alloc(SlabThreadCache* cache, std::size_t size) noexcept {
+        auto n = ROUNDUP(size, SlabSegment::UNIT_SIZE) >> SlabSegment::UNIT_SHIFT;
+        if (unlikely(n >= SlabSegment::UNITS)) {
+            return huge_alloc(size);
         }
+        return cache->alloc_units(n, SlabSegment::SPAN_CLASS);
     }
-    constexpr static std::allocator<uint8_t> allocator {};
-    static constexpr std::size_t MAX_FRAME_SIZE = 4UL << 10;
-    static constexpr std::size_t BASE_SHIFT = 3;
-    static constexpr std::size_t BASE_SIZE = 1UL << BASE_SHIFT;
-    static constexpr std::size_t SLAB_OVERHEAD = sizeof(SlabHeader);
-    static_assert(sizeof(SlabHeader) == sizeof(uint64_t), "");
-    static constexpr uint32_t LOOKUP_MAX_CLASS = MAX_FRAME_SIZE >> BASE_SHIFT;
-    static_assert(1UL << MAX_CLASS_SHIFT == LOOKUP_MAX_CLASS, "");
-    static inline thread_local std::stack<void*> tcache_[LOOKUP_MAX_CLASS];
-    static inline std::size_t roundup(std::size_t size) {
-        return ROUNDUP(size, BASE_SIZE);
+
+    static void* huge_alloc(std::size_t size) noexcept {
+        auto segment = SlabSegment::map(SlabSegment::UNIT_SIZE + size, 0);
+        if (unlikely(segment == nullptr)) {
+            return nullptr;
+        }
+        segment->huge_ = true;
+        return segment->unit_addr(1);
     }
-    static inline uint32_t size2ind(std::size_t size) {
-       return size >> BASE_SHIFT;
+
+    /**
+     * free the blocks other threads returned, return whether class `ind` got
+     * any. bins passing their limit are trimmed by the next free.
+     */
+    static bool reclaim(SlabThreadCache* cache, uint32_t ind = 0) noexcept {
+        auto node = cache->take_remote();
+        while (node) {
+            auto next = node->next_;
+            cache->free_local(node, SlabSegment::of(node));
+            node = next;
+        }
+        return cache->bins_[ind].free_ != nullptr;
     }
-    static inline SlabHeader* ptr2header(void* ptr) {
-        return reinterpret_cast<SlabHeader*>(static_cast<uint8_t*>(ptr) - SLAB_OVERHEAD);
+
+    /* bytes freed into the bin since its last trim pass the class limit */
+    static bool over_limit(const SlabBin& bin, uint32_t ind) noexcept {
+        auto grown = bin.count_.load(std::memory_order_relaxed) - bin.floor_;
+        return static_cast<int32_t>(grown) > 0
+            && SlabSizeClass::size(ind) * grown
+            > class_limit_[ind].load(std::memory_order_relaxed);
     }
+
+    /**
+     * tally the free blocks of class `ind` per slab, unlink the blocks of
+     * slabs with no block in use and give those slabs back, return the
+     * bytes released. the next trim of the class wait for another class
+     * limit worth of frees, so slabs pinned by a few live blocks can't make
+     * the free path quadratic.
+     */
+    static std::size_t trim_class(SlabThreadCache* cache, uint32_t ind) noexcept {
+        constexpr uint16_t RELEASE = UINT16_MAX;
+        constexpr auto PAGE_SHIFT = SlabSegment::PAGE_SHIFT;
+        auto& bin = cache->bins_[ind];
+        auto rsize = SlabSizeClass::size(ind);
+        auto slab_size = SlabSizeClass::pages(ind) * SlabSegment::PAGE_SIZE;
+        // slabs are tallied on their first page
+        auto slab_of = [](SlabSegment* segment, void* ptr) {
+            return segment->units_[segment->index_of(ptr)].first_ >> PAGE_SHIFT;
+        };
+        for (auto node = bin.free_; node; node = node->next_) {
+            auto segment = SlabSegment::of(node);
+            segment->tally_[slab_of(segment, node)]++;
+        }
+        // the slab being carved only handed out blocks up to `bump_`
+        uint8_t* current = bin.end_ ? bin.end_ - slab_size : nullptr;
+        for (auto segment = cache->segments_; segment; segment = segment->next_) {
+            for (uint32_t i = 1; i < SlabSegment::PAGES; i++) {
+                auto& tally = segment->tally_[i];
+                auto& unit = segment->units_[i << PAGE_SHIFT];
+                auto slab = segment->unit_addr(i << PAGE_SHIFT);
+                auto carved = slab == current ? (bin.bump_ - slab) / rsize
+                                              : slab_size / rsize;
+                bool owned = unit.ind_ == ind && unit.first_ == i << PAGE_SHIFT;
+                tally = owned && tally == carved ? RELEASE : 0;
+            }
+        }
+        uint32_t freed = 0;
+        SlabFreeNode** link = &bin.free_;
+        while (*link) {
+            auto node = *link;
+            auto segment = SlabSegment::of(node);
+            if (segment->tally_[slab_of(segment, node)] == RELEASE) {
+                *link = node->next_;
+                freed++;
+            } else {
+                link = &node->next_;
+            }
+        }
+        std::size_t released = 0;
+        for (auto segment = cache->segments_; segment; segment = segment->next_) {
+            for (uint32_t i = 1; i < SlabSegment::PAGES; i++) {
+                if (segment->tally_[i] != RELEASE) {
+                    continue;
+                }
+                auto first = i << PAGE_SHIFT;
+                auto n = segment->units_[first].span_;
+                if (segment->unit_addr(first) == current) {
+                    bin.bump_ = bin.end_ = nullptr;
+                }
+                for (uint32_t u = first; u < first + n; u++) {
+                    segment->units_[u] = {};
+                }
+                segment->free_units(first, n);
+                segment->release_units(first, n);
+                segment->tally_[i] = 0;
+                released += slab_size;
+            }
+        }
+        bin.add_count(-static_cast<int32_t>(freed));
+        bin.floor_ = bin.count_.load(std::memory_order_relaxed);
+        return released;
+    }
+
+    static SlabThreadCache* this_cache() noexcept {
+        if (likely(tcache_ != nullptr)) {
+            return tcache_;
+        }
+        if (unlikely(exited_)) {
+            return nullptr;
+        }
+        return attach();
+    }
+
+    /* adopt an orphaned cache or register a new one */
+    static SlabThreadCache* attach() noexcept {
+        static thread_local struct Detacher {
+            ~Detacher() {
+                detach();
+            }
+        } detacher;
+        (void)detacher;
+        std::lock_guard guard(registry_lock_);
+        auto n = ncaches_.load(std::memory_order_relaxed);
+        for (uint32_t i = 0; i < n; i++) {
+            auto cache = caches_[i].load(std::memory_order_relaxed);
+            if (cache->orphaned_) {
+                cache->orphaned_ = false;
+                return tcache_ = cache;
+            }
+        }
+        if (unlikely(n == MAX_OWNER)) {
+            S_ERROR("slab caches exhausted, {} threads alive", n);
+            return nullptr;
+        }
+        auto cache = new (std::nothrow) SlabThreadCache(n);
+        if (unlikely(cache == nullptr)) {
+            return nullptr;
+        }
+        caches_[n].store(cache, std::memory_order_release);
+        ncaches_.store(n + 1, std::memory_order_relaxed);
+        return tcache_ = cache;
+    }
+
+    /**
+     * orphan the cache on thread exit, its pages and free blocks are kept
+     * for the thread adopting it next.
+     */
+    static void detach() noexcept {
+        auto cache = tcache_;
+        tcache_ = nullptr;
+        exited_ = true;
+        if (cache == nullptr) {
+            return;
+        }
+        std::lock_guard guard(registry_lock_);
+        cache->orphaned_ = true;
+    }
+
+    template<std::size_t... I>
+    static constexpr std::array<std::atomic<std::size_t>, sizeof...(I)>
+    class_limits(std::index_sequence<I...>) noexcept {
+        return {((void)I, std::size_t(1) << 20)...};
+    }
+
+    static constexpr uint32_t MAX_OWNER_SHIFT = 12;
+    static constexpr std::size_t BASE_SIZE = 8;
+    static_assert(sizeof(SlabFreeNode) <= BASE_SIZE, "");
+    static_assert(SlabSizeClass::COUNT <= SlabThreadCache::MAX_CLASS, "");
+    static constexpr uint32_t MAX_OWNER = 1U << MAX_OWNER_SHIFT;
+    static inline thread_local SlabThreadCache* tcache_;
+    static inline thread_local bool exited_;
+    static inline std::mutex registry_lock_;
+    static inline std::array<std::atomic<std::size_t>, SlabSizeClass::COUNT>
+        class_limit_ = class_limits(std::make_index_sequence<SlabSizeClass::COUNT>());
+    static inline std::atomic<uint32_t> ncaches_;
+    static inline std::atomic<SlabThreadCache*> caches_[MAX_OWNER];
 };
 
 } // namespace sqk::common
@@ -0,0 +1,137 @@
+#ifndef SQK_COMMON_MEM_POLICY_HPP_
+#define SQK_COMMON_MEM_POLICY_HPP_
+
+#include <sys/mman.h>
+
+#ifdef SQK_HAS_NUMA
+    #include <numa.h>
+    #include <numaif.h>
+    #include <sched.h>
+#endif
+
+#include <cstddef>
+#include <cstdint>
+
+#include "utilty.h"
+
+namespace sqk::common {
+
+/**
+ * how backing memory is mapped: on which kind of pages and bound to which
+ * NUMA node. hugetlb pages fall back to transparent hugepages when none is
+ * reserved, and node binding is a no-op without libnuma.
+ *
+ * LOCAL_NODE bind to the node of the cpu the mapping thread run on, which
+ * is the node of a pinned worker.
+ */
+struct MemPolicy {
+    enum class PageType : uint8_t {
+        NORMAL,
+        TRANSPARENT, /**< THP via madvise(MADV_HUGEPAGE) */
+        HUGETLB, /**< MAP_HUGETLB, THP if no hugepage is free */
+    };
+
+    static constexpr int ANY_NODE = -1;
+    static constexpr int LOCAL_NODE = -2;
+    static constexpr std::size_t PAGE_SIZE = 4096;
+    static constexpr std::size_t HUGEPAGE_SIZE = 2UL << 20;
+
+    PageType page_ {PageType::NORMAL};
+    int node_ {ANY_NODE};
+
+    /**
+     * map `size` bytes aligned to `align`, a power of two up to
+     * HUGEPAGE_SIZE. `size` is rounded up to the page size and must be
+     * passed back to `unmap`. return nullptr on failure.
+     */
+    void* map(std::size_t& size, std::size_t align = PAGE_SIZE) const noexcept {
+        void* addr = MAP_FAILED;
+#ifdef MAP_HUGETLB
+        if (page_ == PageType::HUGETLB) {
+            std::size_t huge_size = round_up(size, HUGEPAGE_SIZE);
+            addr = mmap(
+                nullptr,
+                huge_size,
+                PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,
+                -1,
+                0
+            );
+            if (addr != MAP_FAILED) {
+                size = huge_size;
+            }
+        }
+#endif
+        if (addr == MAP_FAILED) {
+            bool thp = page_ != PageType::NORMAL && size >= HUGEPAGE_SIZE;
+            size = round_up(size, PAGE_SIZE);
+            addr = map_aligned(size, thp ? HUGEPAGE_SIZE : align);
+            if (unlikely(addr == nullptr)) {
+                return nullptr;
+            }
+#ifdef MADV_HUGEPAGE
+            if (thp) {
+                madvise(addr, size, MADV_HUGEPAGE);
+            }
+#endif
+        }
+        this->bind(addr, size);
+        return addr;
+    }
+
+    static void unmap(void* addr, std::size_t size) noexcept {
+        munmap(addr, size);
+    }
+
+  private:
+    static constexpr std::size_t round_up(std::size_t size, std::size_t align) {
+        return (size + align - 1) & ~(align - 1);
+    }
+
+    static void* map_aligned(std::size_t size, std::size_t align) noexcept {
+        auto raw = static_cast<uint8_t*>(mmap(
+            nullptr,
+            size + align - PAGE_SIZE,
+            PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS,
+            -1,
+            0
+        ));
+        if (unlikely(raw == MAP_FAILED)) {
+            return nullptr;
+        }
+        auto base = reinterpret_cast<uint8_t*>(
+            round_up(reinterpret_cast<uintptr_t>(raw), align)
+        );
+        if (base != raw) {
+            munmap(raw, base - raw);
+        }
+        if (auto tail = raw + align - PAGE_SIZE - base; tail > 0) {
+            munmap(base + size, tail);
+        }
+        return base;
+    }
+
+    /* must run before the first touch, pages are placed on fault */
+    void bind(void* addr, std::size_t size) const noexcept {
+#ifdef SQK_HAS_NUMA
+        if (node_ == ANY_NODE || numa_available() < 0) {
+            return;
+        }
+        int node = node_ == LOCAL_NODE ? numa_node_of_cpu(sched_getcpu()) : node_;
+        if (node < 0) {
+            return;
+        }
+        unsigned long mask[16] {};
+        mask[node / 64] = 1UL << (node % 64);
+        mbind(addr, size, MPOL_BIND, mask, sizeof(mask) * 8, 0);
+#else
+        (void)addr;
+        (void)size;
+#endif
+    }
+};
+
+} // namespace sqk::common
+
+#endif // !SQK_COMMON_MEM_POLICY_HPP_
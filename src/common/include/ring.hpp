@@ -3,7 +3,10 @@
 
 #include <emmintrin.h>
 
+#include <algorithm>
+#include <cstddef>
 #include <cstdint>
+#include <span>
 
 #include "log.hpp"
 #include "utilty.h"
@@ -132,6 +135,7 @@ namespace sqk::common {
 struct MemZone {
     uint8_t* addr_;
     ssize_t size_;
+    bool mapped_; /**< mapped by a `MemPolicy` rather than the allocator */
 };
 
 struct RingHeadTail_Normal {
@@ -139,15 +143,33 @@ struct RingHeadTail_Normal {
     volatile uint32_t tail_;
 };
 
+/**
+ * RTS head/tail: `pos_` is the ring index, `cnt_` counts the updates, the
+ * tail catches up with the head position only when every thread which has
+ * moved the head has also finished its update.
+ */
 union RingRtsPosCnt {
     alignas(sizeof(uint64_t)) std::atomic<uint64_t> raw_;
 
     struct {
-        uint32_t head_;
-        uint32_t tail_;
+        uint32_t cnt_;
+        uint32_t pos_;
     } val;
+
+    RingRtsPosCnt() {}
 };
 
+union RingRtsPosCntPlain {
+    alignas(sizeof(uint64_t)) uint64_t raw_;
+
+    struct {
+        uint32_t cnt_;
+        uint32_t pos_;
+    } val;
+};
+
+static_assert(sizeof(RingRtsPosCntPlain) == sizeof(RingRtsPosCnt), "");
+
 union RingHtsPos {
     alignas(sizeof(uint64_t)) std::atomic<uint64_t> raw_;
 
@@ -178,13 +200,20 @@ union RingHeadTail {
 
     RingHtsPos ht;
 
+    /* tail_.val.pos_ shares offset with `tail_` so other modes can read it */
     struct {
-        volatile RingRtsPosCnt head_;
-        uint32_t htd_max_;
         volatile RingRtsPosCnt tail_;
+        uint32_t pad_;
+        uint32_t htd_max_;
+        volatile RingRtsPosCnt head_;
     } rts;
 };
 
+static_assert(
+    offsetof(RingHeadTail, rts.tail_.val.pos_) == offsetof(RingHeadTail, tail_),
+    ""
+);
+
 enum class RingSyncType {
     SQK_RING_SYNC_MT, /**< multi-thread safe (default mode) */
     SQK_RING_SYNC_ST, /**< single thread only */
@@ -219,14 +248,22 @@ struct Ring {
     static constexpr uint32_t HTD_MAX_DEF = 8;
 
     void init(uint32_t sz) {
-        std::memset(this, 0, sizeof(Ring<T>));
+        std::memset(this, 0, sizeof(Ring));
         this->size = sz;
         this->mask = sz - 1;
         this->capacity = this->mask;
         this->htd_max_ = this->capacity / HTD_MAX_DEF;
+        if constexpr (prod_sync_type == RingSyncType::SQK_RING_SYNC_MT_RTS) {
+            this->prod_.rts.htd_max_ = this->htd_max_;
+        }
+        if constexpr (cons_sync_type == RingSyncType::SQK_RING_SYNC_MT_RTS) {
+            this->cons_.rts.htd_max_ = this->htd_max_;
+        }
     }
 
-    template<RingSyncType sync_type = prod_sync_type>
+    template<
+        RingSyncType sync_type = prod_sync_type,
+        bool fixed = transactional_prod>
         requires(
             sync_type == RingSyncType::SQK_RING_SYNC_MT
             || sync_type == RingSyncType::SQK_RING_SYNC_ST
@@ -273,7 +310,7 @@ struct Ring {
             free_entries = (capacity + cons_tail - old_head);
             /* check that we have enough room in ring */
             if (unlikely(n > free_entries)) {
-                if constexpr (transactional_prod) {
+                if constexpr (fixed) {
                     n = 0;
                 } else {
                     n = free_entries;
@@ -302,14 +339,178 @@ struct Ring {
         return n;
     }
 
-    template<RingSyncType sync_type = prod_sync_type>
+    /**
+     * wait while the head is more than `htd_max_` ahead of the tail, it
+     * bound how far a preempted thread can hold back the others
+     */
+    void rts_head_wait(const RingHeadTail& ht, RingRtsPosCntPlain& h) {
+        const uint32_t max = ht.rts.htd_max_;
+        while (h.val.pos_ - ht.rts.tail_.val.pos_ > max) {
+            sqk_pause();
+            h.raw_ = std::atomic_load_explicit(
+                &ht.rts.head_.raw_,
+                std::memory_order_acquire
+            );
+        }
+    }
+
+    /**
+     * tail is moved to the head position by the last thread finishing its
+     * update, others only bump the update counter
+     */
+    void rts_update_tail(RingHeadTail& ht) {
+        RingRtsPosCntPlain h, ot, nt;
+
+        ot.raw_ = std::atomic_load_explicit(
+            &ht.rts.tail_.raw_,
+            std::memory_order_acquire
+        );
+        do {
+            h.raw_ = std::atomic_load_explicit(
+                &ht.rts.head_.raw_,
+                std::memory_order_relaxed
+            );
+            nt.raw_ = ot.raw_;
+            if (++nt.val.cnt_ == h.val.cnt_) {
+                nt.val.pos_ = h.val.pos_;
+            }
+        } while (std::atomic_compare_exchange_strong_explicit(
+                     &ht.rts.tail_.raw_,
+                     &ot.raw_,
+                     nt.raw_,
+                     std::memory_order_release,
+                     std::memory_order_acquire
+                 )
+                 == 0);
+    }
+
+    template<
+        RingSyncType sync_type = prod_sync_type,
+        bool fixed = transactional_prod>
         requires(sync_type == RingSyncType::SQK_RING_SYNC_MT_RTS)
-    uint32_t move_prod_head(
-        uint32_t n,
-        uint32_t& old_head,
-        uint32_t& new_head,
-        uint32_t& free_entries
-    ) {}
+    uint32_t
+    move_prod_head(uint32_t num, uint32_t& old_head, uint32_t& free_entries) {
+        uint32_t n;
+        RingRtsPosCntPlain nh, oh;
+        const uint32_t capacity = this->capacity;
+
+        oh.raw_ = std::atomic_load_explicit(
+            &this->prod_.rts.head_.raw_,
+            std::memory_order_acquire
+        );
+        do {
+            /* Reset n to the initial burst count */
+            n = num;
+
+            /*
+             * wait for prod head/tail distance,
+             * make sure that we read prod head *before*
+             * reading cons tail.
+             */
+            this->rts_head_wait(this->prod_, oh);
+
+            /*
+             *  The subtraction is done between two unsigned 32bits value
+             * (the result is always modulo 32 bits even if we have
+             * *old_head > cons_tail). So 'free_entries' is always between 0
+             * and capacity (which is < size).
+             */
+            free_entries = capacity + this->cons_.tail_ - oh.val.pos_;
+
+            /* check that we have enough room in ring */
+            if (unlikely(n > free_entries)) {
+                if constexpr (fixed) {
+                    n = 0;
+                } else {
+                    n = free_entries;
+                }
+            }
+
+            if (n == 0) {
+                break;
+            }
+
+            nh.val.pos_ = oh.val.pos_ + n;
+            nh.val.cnt_ = oh.val.cnt_ + 1;
+            /*
+             * this CAS(ACQUIRE, ACQUIRE) serves as a hoist barrier to prevent:
+             *  - OOO reads of cons tail value
+             *  - OOO copy of elems to the ring
+             */
+        } while (std::atomic_compare_exchange_strong_explicit(
+                     &this->prod_.rts.head_.raw_,
+                     &oh.raw_,
+                     nh.raw_,
+                     std::memory_order_acquire,
+                     std::memory_order_acquire
+                 )
+                 == 0);
+        old_head = oh.val.pos_;
+        return n;
+    }
+
+    template<
+        RingSyncType sync_type = cons_sync_type,
+        bool fixed = transactional_cons>
+        requires(sync_type == RingSyncType::SQK_RING_SYNC_MT_RTS)
+    uint32_t
+    move_cons_head(uint32_t num, uint32_t& old_head, uint32_t& entries) {
+        uint32_t n;
+        RingRtsPosCntPlain nh, oh;
+
+        oh.raw_ = std::atomic_load_explicit(
+            &this->cons_.rts.head_.raw_,
+            std::memory_order_acquire
+        );
+        do {
+            /* Restore n as it may change every loop */
+            n = num;
+
+            /*
+             * wait for cons head/tail distance,
+             * make sure that we read cons head *before*
+             * reading prod tail.
+             */
+            this->rts_head_wait(this->cons_, oh);
+
+            /* The subtraction is done between two unsigned 32bits value
+             * (the result is always modulo 32 bits even if we have
+             * cons_head > prod_tail). So 'entries' is always between 0
+             * and size(ring)-1.
+             */
+            entries = this->prod_.tail_ - oh.val.pos_;
+
+            /* Set the actual entries for dequeue */
+            if (n > entries) {
+                if constexpr (fixed) {
+                    n = 0;
+                } else {
+                    n = entries;
+                }
+            }
+
+            if (unlikely(n == 0)) {
+                break;
+            }
+
+            nh.val.pos_ = oh.val.pos_ + n;
+            nh.val.cnt_ = oh.val.cnt_ + 1;
+            /*
+             * this CAS(ACQUIRE, ACQUIRE) serves as a hoist barrier to prevent:
+             *  - OOO reads of prod tail value
+             *  - OOO copy of elems from the ring
+             */
+        } while (std::atomic_compare_exchange_strong_explicit(
+                     &this->cons_.rts.head_.raw_,
+                     &oh.raw_,
+                     nh.raw_,
+                     std::memory_order_acquire,
+                     std::memory_order_acquire
+                 )
+                 == 0);
+        old_head = oh.val.pos_;
+        return n;
+    }
 
     void hts_head_wait(const RingHtsPos& ht, RingHtsPosPlain& p) {
         while (p.pos.head_ != p.pos.tail_) {
@@ -344,7 +545,9 @@ struct Ring {
         );
     }
 
-    template<RingSyncType sync_type = prod_sync_type>
+    template<
+        RingSyncType sync_type = prod_sync_type,
+        bool fixed = transactional_prod>
         requires(sync_type == RingSyncType::SQK_RING_SYNC_MT_HTS)
     uint32_t
     move_prod_head(uint32_t num, uint32_t& old_head, uint32_t& free_entries) {
@@ -373,7 +576,7 @@ struct Ring {
 
             /* check that we have enough room in ring */
             if (unlikely(n > free_entries)) {
-                if constexpr (transactional_prod) {
+                if constexpr (fixed) {
                     n = 0;
                 } else {
                     n = free_entries;
@@ -561,7 +764,9 @@ struct Ring {
         );
     }
 
-    template<RingSyncType sync_type = cons_sync_type>
+    template<
+        RingSyncType sync_type = cons_sync_type,
+        bool fixed = transactional_cons>
         requires(sync_type == RingSyncType::SQK_RING_SYNC_MT_HTS)
     uint32_t
     move_cons_head(uint32_t num, uint32_t& old_head, uint32_t& entries) {
@@ -592,7 +797,7 @@ struct Ring {
 
             /* Set the actual entries for dequeue */
             if (n > entries) {
-                if constexpr (transactional_cons) {
+                if constexpr (fixed) {
                     n = 0;
                 } else {
                     n = entries;
@@ -622,7 +827,9 @@ struct Ring {
         return n;
     }
 
-    template<RingSyncType sync_type = cons_sync_type>
+    template<
+        RingSyncType sync_type = cons_sync_type,
+        bool fixed = transactional_cons>
         requires(
             sync_type == RingSyncType::SQK_RING_SYNC_MT
             || sync_type == RingSyncType::SQK_RING_SYNC_ST
@@ -671,7 +878,7 @@ struct Ring {
 
             /* Set the actual entries for dequeue */
             if (n > entries) {
-                if constexpr (transactional_cons) {
+                if constexpr (fixed) {
                     n = 0;
                 } else {
                     n = entries;
@@ -834,6 +1041,10 @@ struct Ring {
     static inline Allocator allocator;
 
     static void free(Ring* ring) {
+        if (ring->memzone_.mapped_) {
+            MemPolicy::unmap(ring, ring->memzone_.size_);
+            return;
+        }
         allocator_traits::deallocate(
             allocator,
             reinterpret_cast<uint8_t*>(ring),
@@ -842,6 +1053,97 @@ struct Ring {
     }
 
     static Ring* of(uint32_t cnt) {
+        return of(cnt, nullptr);
+    }
+
+    /**
+     * map the ring following `policy` instead of using `Allocator`, e.g. on
+     * hugepages of the node its consumer run on. the ring is prefaulted.
+     */
+    static Ring* of(uint32_t cnt, const MemPolicy& policy) {
+        return of(cnt, &policy);
+    }
+
+    /**
+     * Number of entries in the ring, the value may be stale as soon as it
+     * was returned if there are concurrent producers or consumers.
+     */
+    uint32_t count() const {
+        uint32_t prod_tail = this->prod_.tail_;
+        uint32_t cons_tail = this->cons_.tail_;
+        uint32_t count = (prod_tail - cons_tail) & this->mask;
+        return (count > this->capacity) ? this->capacity : count;
+    }
+
+    /**
+     * max head/tail distance of RTS producers, a smaller value bound the
+     * stall caused by a preempted producer tighter, at the cost of more
+     * waiting of the others
+     */
+    template<RingSyncType sync_type = prod_sync_type>
+        requires(sync_type == RingSyncType::SQK_RING_SYNC_MT_RTS)
+    void set_prod_htd_max(uint32_t v) {
+        this->prod_.rts.htd_max_ = std::min(v, this->capacity);
+    }
+
+    template<RingSyncType sync_type = cons_sync_type>
+        requires(sync_type == RingSyncType::SQK_RING_SYNC_MT_RTS)
+    void set_cons_htd_max(uint32_t v) {
+        this->cons_.rts.htd_max_ = std::min(v, this->capacity);
+    }
+
+    uint32_t free_count() const {
+        return this->capacity - this->count();
+    }
+
+    bool empty() const {
+        return this->prod_.tail_ == this->cons_.tail_;
+    }
+
+    template<typename T2>
+    uint32_t enqueue(T2&& entry) {
+        const T value(std::forward<T2>(entry));
+        return this->do_enqueue<transactional_prod>(&value, 1);
+    }
+
+    uint32_t dequeue(T& entry) {
+        return this->do_dequeue<transactional_cons>(&entry, 1);
+    }
+
+    /**
+     * enqueue all of `entries` or none of them, return the number of
+     * entries enqueued
+     */
+    uint32_t enqueue_bulk(std::span<const T> entries) {
+        return this->do_enqueue<true>(entries.data(), entries.size());
+    }
+
+    /**
+     * enqueue as many of `entries` as the free space allows, return the
+     * number of entries enqueued
+     */
+    uint32_t enqueue_burst(std::span<const T> entries) {
+        return this->do_enqueue<false>(entries.data(), entries.size());
+    }
+
+    /**
+     * fill all of `entries` or dequeue nothing, return the number of
+     * entries dequeued
+     */
+    uint32_t dequeue_bulk(std::span<T> entries) {
+        return this->do_dequeue<true>(entries.data(), entries.size());
+    }
+
+    /**
+     * dequeue up to `entries.size()` entries with one head/tail update,
+     * return the number of entries dequeued
+     */
+    uint32_t dequeue_burst(std::span<T> entries) {
+        return this->do_dequeue<false>(entries.data(), entries.size());
+    }
+
+  private:
+    static Ring* of(uint32_t cnt, const MemPolicy* policy) {
         ssize_t sz;
         uint32_t esize = sizeof(T);
         auto count = sqk_align32pow2(cnt + 1);
@@ -857,27 +1159,46 @@ struct Ring {
         sz = sizeof(Ring) + count * esize;
         sz = SQK_ALIGN(sz, SQK_CACHE_LINESIZE);
 
-        void* buf = allocator_traits::allocate(allocator, sz);
+        void* buf;
+        if (policy) {
+            std::size_t size = sz;
+            buf = policy->map(size);
+            if (unlikely(buf == nullptr)) {
+                throw std::bad_alloc();
+            }
+#ifdef __linux__
+            madvise(buf, size, MADV_POPULATE_WRITE);
+#endif
+            sz = size;
+        } else {
+            buf = allocator_traits::allocate(allocator, sz);
+        }
         auto ring = static_cast<Ring*>(buf);
-        ring->init(cnt);
+        ring->init(count);
         ring->memzone_.addr_ = static_cast<uint8_t*>(buf) + sizeof(Ring);
         ring->memzone_.size_ = sz;
+        ring->memzone_.mapped_ = policy != nullptr;
 
         return ring;
     }
 
-    template<typename T2>
-    uint32_t enqueue(T2&& entry) {
+    template<bool fixed>
+    uint32_t do_enqueue(const T* entries, uint32_t num) {
         if constexpr (prod_sync_type == RingSyncType::SQK_RING_SYNC_ST
                       || prod_sync_type == RingSyncType::SQK_RING_SYNC_MT) {
             uint32_t prod_head, prod_next;
             uint32_t free_entries;
             uint32_t n;
-            n = this->move_prod_head(1, prod_head, prod_next, free_entries);
+            n = this->template move_prod_head<prod_sync_type, fixed>(
+                num,
+                prod_head,
+                prod_next,
+                free_entries
+            );
             if (!n) {
                 return 0;
             }
-            this->enqueue_elements(prod_head, &entry, n);
+            this->enqueue_elements(prod_head, entries, n);
             this->update_tail(
                 this->prod_,
                 prod_head,
@@ -890,29 +1211,50 @@ struct Ring {
                              == RingSyncType::SQK_RING_SYNC_MT_HTS) {
             uint32_t free, head;
             uint32_t n;
-            n = move_prod_head(1, head, free);
+            n = this->template move_prod_head<prod_sync_type, fixed>(
+                num,
+                head,
+                free
+            );
             if (n != 0) {
-                this->enqueue_elements(head, &entry, n);
+                this->enqueue_elements(head, entries, n);
                 this->update_tail(this->prod_, head, n, 1);
             }
             return n;
         } else if constexpr (prod_sync_type
                              == RingSyncType::SQK_RING_SYNC_MT_RTS) {
-            assert(0);
+            uint32_t free, head;
+            uint32_t n;
+            n = this->template move_prod_head<prod_sync_type, fixed>(
+                num,
+                head,
+                free
+            );
+            if (n != 0) {
+                this->enqueue_elements(head, entries, n);
+                this->rts_update_tail(this->prod_);
+            }
+            return n;
         }
     }
 
-    uint32_t dequeue(T& entry) {
+    template<bool fixed>
+    uint32_t do_dequeue(T* entries, uint32_t num) {
         if constexpr (cons_sync_type == RingSyncType::SQK_RING_SYNC_ST
                       || cons_sync_type == RingSyncType::SQK_RING_SYNC_MT) {
             uint32_t cons_head, cons_next;
-            uint32_t entries;
+            uint32_t avail;
 
-            uint32_t n = this->move_cons_head(1, cons_head, cons_next, entries);
+            uint32_t n = this->template move_cons_head<cons_sync_type, fixed>(
+                num,
+                cons_head,
+                cons_next,
+                avail
+            );
             if (!n) {
                 return 0;
             }
-            this->dequeue_elements(cons_head, &entry, n);
+            this->dequeue_elements(cons_head, entries, n);
             this->update_tail(
                 this->cons_,
                 cons_head,
@@ -923,20 +1265,37 @@ struct Ring {
             return n;
         } else if constexpr (cons_sync_type
                              == RingSyncType::SQK_RING_SYNC_MT_HTS) {
-            uint32_t entries, head;
+            uint32_t avail, head;
             uint32_t n;
 
-            n = move_cons_head(1, head, entries);
+            n = this->template move_cons_head<cons_sync_type, fixed>(
+                num,
+                head,
+                avail
+            );
 
             if (n != 0) {
-                this->dequeue_elements(head, &entry, n);
+                this->dequeue_elements(head, entries, n);
                 this->update_tail(this->cons_, head, n, 0);
             }
             return n;
 
         } else if constexpr (cons_sync_type
                              == RingSyncType::SQK_RING_SYNC_MT_RTS) {
-            assert(0);
+            uint32_t avail, head;
+            uint32_t n;
+
+            n = this->template move_cons_head<cons_sync_type, fixed>(
+                num,
+                head,
+                avail
+            );
+
+            if (n != 0) {
+                this->dequeue_elements(head, entries, n);
+                this->rts_update_tail(this->cons_);
+            }
+            return n;
         }
     }
 };
@@ -7,6 +7,8 @@
 
 #include <memory>
 
+#include "mem_policy.hpp"
+
 namespace sqk::common {
 
 template<typename T>
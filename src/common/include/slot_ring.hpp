@@ -0,0 +1,224 @@
+#ifndef SQK_COMMON_SLOT_RING_HPP_
+#define SQK_COMMON_SLOT_RING_HPP_
+
+#include <atomic>
+#include <cstdint>
+#include <new>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+
+#include "log.hpp"
+#include "ring.hpp"
+#include "ring_generic_allocator.hpp"
+
+namespace sqk::common {
+
+/**
+ * bounded MPMC ring of typed slots, elements are move-constructed in place
+ * by the producer and moved out by the consumer, so `T` needn't be
+ * trivially copyable nor a multiple of 4 bytes.
+ *
+ * every slot carries a sequence number telling whose turn it is: a slot at
+ * position `pos` is writable when `seq_ == pos` and readable when
+ * `seq_ == pos + 1`, a producer or consumer claim a position with one CAS
+ * on `head_`/`tail_`, then own the slot exclusively until it publish the
+ * next sequence.
+ *
+ * a claimed slot must be published, otherwise every later producer or
+ * consumer stall on it, so constructing an element and moving it out must
+ * not throw.
+ */
+template<typename T, typename Allocator = Allocator<uint8_t>>
+struct SlotRing {
+    static_assert(std::is_nothrow_move_assignable_v<T>, "");
+    static_assert(std::is_nothrow_destructible_v<T>, "");
+
+  private:
+    struct Slot {
+        std::atomic<uint32_t> seq_;
+        alignas(T) uint8_t storage_[sizeof(T)];
+
+        T* get() {
+            return std::launder(reinterpret_cast<T*>(storage_));
+        }
+    };
+
+    static_assert(alignof(Slot) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__, "");
+
+    uint32_t size_; /**< Size of ring, all slots are usable. */
+    uint32_t mask_; /**< Mask (size-1) of ring. */
+    MemZone memzone_;
+    SQK_CACHELINE_ALIGNED std::atomic<uint32_t> head_; /**< next enqueue */
+    SQK_CACHELINE_ALIGNED std::atomic<uint32_t> tail_; /**< next dequeue */
+    SQK_CACHELINE_ALIGNED uint8_t pad0;
+    SlotRing() = delete;
+    ~SlotRing() = delete;
+    using allocator_traits = std::allocator_traits<Allocator>;
+
+    Slot* slots() {
+        return reinterpret_cast<Slot*>(&this[1]);
+    }
+
+    void init(uint32_t sz) {
+        this->size_ = sz;
+        this->mask_ = sz - 1;
+        new (&this->head_) std::atomic<uint32_t>(0);
+        new (&this->tail_) std::atomic<uint32_t>(0);
+        for (uint32_t i = 0; i < sz; i++) {
+            new (&slots()[i].seq_) std::atomic<uint32_t>(i);
+        }
+    }
+
+  public:
+    static inline Allocator allocator;
+
+    static SlotRing* of(uint32_t cnt) {
+        return of(cnt, nullptr);
+    }
+
+    /* map the ring following `policy` instead of using `Allocator` */
+    static SlotRing* of(uint32_t cnt, const MemPolicy& policy) {
+        return of(cnt, &policy);
+    }
+
+    /* destroy the elements left in ring, caller must be the only user */
+    static void free(SlotRing* ring) {
+        uint32_t head = ring->head_.load(std::memory_order_acquire);
+        for (uint32_t pos = ring->tail_.load(std::memory_order_acquire);
+             pos != head;
+             pos++) {
+            ring->slots()[pos & ring->mask_].get()->~T();
+        }
+        if (ring->memzone_.mapped_) {
+            MemPolicy::unmap(ring, ring->memzone_.size_);
+            return;
+        }
+        allocator_traits::deallocate(
+            allocator,
+            reinterpret_cast<uint8_t*>(ring),
+            ring->memzone_.size_
+        );
+    }
+
+  private:
+    static SlotRing* of(uint32_t cnt, const MemPolicy* policy) {
+        auto count = sqk_align32pow2(std::max(cnt, 2U));
+        if ((!POWEROF2(count)) || (count > SQK_RING_SZ_MASK)) {
+            S_ERROR(
+                "Requested number of elements is invalid, must be power of 2, and not exceed {}",
+                SQK_RING_SZ_MASK
+            );
+            throw std::system_error(EINVAL, std::system_category());
+        }
+
+        ssize_t sz = sizeof(SlotRing) + count * sizeof(Slot);
+        sz = SQK_ALIGN(sz, SQK_CACHE_LINESIZE);
+
+        void* buf;
+        if (policy) {
+            std::size_t size = sz;
+            buf = policy->map(size);
+            if (unlikely(buf == nullptr)) {
+                throw std::bad_alloc();
+            }
+            sz = size;
+        } else {
+            buf = allocator_traits::allocate(allocator, sz);
+        }
+        auto ring = static_cast<SlotRing*>(buf);
+        ring->init(count);
+        ring->memzone_.addr_ = static_cast<uint8_t*>(buf) + sizeof(SlotRing);
+        ring->memzone_.size_ = sz;
+        ring->memzone_.mapped_ = policy != nullptr;
+        return ring;
+    }
+
+  public:
+    /**
+     * construct an element in place from `args`, return 0 if the ring is
+     * full, `args` are untouched then
+     */
+    template<typename... Args>
+    uint32_t emplace(Args&&... args) {
+        static_assert(std::is_nothrow_constructible_v<T, Args&&...>, "");
+        Slot* slot;
+        uint32_t pos = head_.load(std::memory_order_relaxed);
+        for (;;) {
+            slot = &slots()[pos & mask_];
+            uint32_t seq = slot->seq_.load(std::memory_order_acquire);
+            int32_t diff = static_cast<int32_t>(seq - pos);
+            if (diff == 0) {
+                if (head_.compare_exchange_weak(
+                        pos,
+                        pos + 1,
+                        std::memory_order_relaxed
+                    )) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return 0;
+            } else {
+                pos = head_.load(std::memory_order_relaxed);
+            }
+        }
+        new (slot->storage_) T(std::forward<Args>(args)...);
+        slot->seq_.store(pos + 1, std::memory_order_release);
+        return 1;
+    }
+
+    template<typename T2>
+    uint32_t enqueue(T2&& entry) {
+        return this->emplace(std::forward<T2>(entry));
+    }
+
+    /**
+     * move the oldest element into `entry`, return 0 if the ring is empty
+     */
+    uint32_t dequeue(T& entry) {
+        Slot* slot;
+        uint32_t pos = tail_.load(std::memory_order_relaxed);
+        for (;;) {
+            slot = &slots()[pos & mask_];
+            uint32_t seq = slot->seq_.load(std::memory_order_acquire);
+            int32_t diff = static_cast<int32_t>(seq - (pos + 1));
+            if (diff == 0) {
+                if (tail_.compare_exchange_weak(
+                        pos,
+                        pos + 1,
+                        std::memory_order_relaxed
+                    )) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return 0;
+            } else {
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+        T* elem = slot->get();
+        entry = std::move(*elem);
+        elem->~T();
+        slot->seq_.store(pos + mask_ + 1, std::memory_order_release);
+        return 1;
+    }
+
+    /**
+     * Number of entries in the ring, the value may be stale as soon as it
+     * was returned if there are concurrent producers or consumers.
+     */
+    uint32_t count() const {
+        uint32_t head = head_.load(std::memory_order_relaxed);
+        uint32_t tail = tail_.load(std::memory_order_relaxed);
+        uint32_t count = head - tail;
+        return (count > size_) ? size_ : count;
+    }
+
+    bool empty() const {
+        return count() == 0;
+    }
+};
+
+} // namespace sqk::common
+
+#endif // !SQK_COMMON_SLOT_RING_HPP_
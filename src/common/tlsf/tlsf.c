@@ -457,8 +457,6 @@ static __inline__ bhdr_t *process_area(void *area, size_t size)
 /******************** Begin of the allocator code *****************/
 /******************************************************************/
 
-static __thread __attribute__((tls_model("initial-exec"))) char*  mp = NULL; /* Default memory pool. */
-
 /******************************************************************/
 size_t init_memory_pool(size_t mem_pool_size, void *mem_pool)
 {
@@ -478,13 +476,10 @@ size_t init_memory_pool(size_t mem_pool_size, void *mem_pool)
     tlsf = (tlsf_t *) mem_pool;
     /* Check if already initialised */
     if (tlsf->tlsf_signature == TLSF_SIGNATURE) {
-        mp = mem_pool;
-        b = GET_NEXT_BLOCK(mp, ROUNDUP_SIZE(sizeof(tlsf_t)));
+        b = GET_NEXT_BLOCK(mem_pool, ROUNDUP_SIZE(sizeof(tlsf_t)));
         return b->size & BLOCK_SIZE;
     }
 
-    mp = mem_pool;
-
     /* Zeroing the memory pool */
     memset(mem_pool, 0, sizeof(tlsf_t));
 
@@ -620,84 +615,6 @@ void destroy_memory_pool(void *mem_pool)
 }
 
 
-/******************************************************************/
-void *tlsf_malloc(size_t size)
-{
-/******************************************************************/
-    void *ret;
-
-#if USE_MMAP || USE_SBRK
-    if (!mp) {
-        size_t area_size;
-        void *area;
-
-        area_size = sizeof(tlsf_t) + BHDR_OVERHEAD * 8; /* Just a safety constant */
-        area_size = (area_size > DEFAULT_AREA_SIZE) ? area_size : DEFAULT_AREA_SIZE;
-        area = get_new_area(&area_size);
-        if (area == ((void *) ~0))
-            return NULL;        /* Not enough system memory */
-        init_memory_pool(area_size, area);
-    }
-#endif
-
-    TLSF_ACQUIRE_LOCK(&((tlsf_t *)mp)->lock);
-
-    ret = malloc_ex(size, mp);
-
-    TLSF_RELEASE_LOCK(&((tlsf_t *)mp)->lock);
-
-    return ret;
-}
-
-/******************************************************************/
-void tlsf_free(void *ptr)
-{
-/******************************************************************/
-
-    TLSF_ACQUIRE_LOCK(&((tlsf_t *)mp)->lock);
-
-    free_ex(ptr, mp);
-
-    TLSF_RELEASE_LOCK(&((tlsf_t *)mp)->lock);
-
-}
-
-/******************************************************************/
-void *tlsf_realloc(void *ptr, size_t size)
-{
-/******************************************************************/
-    void *ret;
-
-#if USE_MMAP || USE_SBRK
-	if (!mp) {
-		return tlsf_malloc(size);
-	}
-#endif
-
-    TLSF_ACQUIRE_LOCK(&((tlsf_t *)mp)->lock);
-
-    ret = realloc_ex(ptr, size, mp);
-
-    TLSF_RELEASE_LOCK(&((tlsf_t *)mp)->lock);
-
-    return ret;
-}
-
-/******************************************************************/
-void *tlsf_calloc(size_t nelem, size_t elem_size)
-{
-/******************************************************************/
-    void *ret;
-
-    TLSF_ACQUIRE_LOCK(&((tlsf_t *)mp)->lock);
-
-    ret = calloc_ex(nelem, elem_size, mp);
-
-    TLSF_RELEASE_LOCK(&((tlsf_t *)mp)->lock);
-
-    return ret;
-}
-
 /******************************************************************/
 void *malloc_ex(size_t size, void *mem_pool)
 {
@@ -902,25 +819,6 @@ void *calloc_ex(size_t nelem, size_t elem_size, void *mem_pool)
     return ptr;
 }
 
-__attribute__((constructor)) void
-initialize_tlsf()
-{
-    unsigned long sz = 0;
-    const char *sz_s = getenv("COMMON_ALLOCATOR_SIZE_MB");
-    if (sz_s) {
-        sz = atoi(sz_s);
-    }
-    if (!sz) {
-        sz = 256; // default 256M
-    }
-    sz <<= 20;
-    void* pool = malloc(sz);
-#ifdef __linux__
-    madvise(pool, sz, MADV_POPULATE_WRITE);
-#endif
-    init_memory_pool(sz, pool);
-}
-
 #if _DEBUG_TLSF_
 
 /***************  DEBUG FUNCTIONS   **************/
@@ -1,14 +1,263 @@
-#ifndef SQK_COMMON_TLSF_ALLOCATOR_HPP_
-#define SQK_COMMON_TLSF_ALLOCATOR_HPP_
-
 #include <tlsf.h>
+
+#include <cstdlib>
+
 #include "allocator.hpp"
+
 namespace sqk::common {
 
+namespace {
+
+struct TlsfPool;
+
+struct TlsfFreeNode {
+    TlsfFreeNode* next_;
+};
+
+/**
+ * header at the base of every mapping a pool allocate from, areas are
+ * AREA_SIZE and aligned to it, so the owning pool of any block is found by
+ * masking its address. blocks above HUGE_SIZE get a dedicated mapping of
+ * their own, unmapped on free from any thread.
+ *
+ * the header keep areas apart, TLSF never merge blocks across two
+ * neighbouring mappings.
+ */
+struct TlsfArea {
+    static constexpr uint32_t AREA_MAGIC = 0x2A59FA5A;
+    static constexpr std::size_t AREA_SHIFT = 21;
+    static constexpr std::size_t AREA_SIZE = 1UL << AREA_SHIFT;
+    static constexpr std::size_t HEADER_SIZE = 64;
+    static constexpr std::size_t HUGE_SIZE = AREA_SIZE / 8;
+
+    uint32_t magic_;
+    bool huge_;
+    std::size_t size_; /**< size of the mapping */
+    TlsfPool* pool_;
+
+    static inline std::atomic<std::size_t> mapped_;
+    static inline MemPolicy policy_;
+
+    static TlsfArea* of(void* ptr) noexcept {
+        return reinterpret_cast<TlsfArea*>(
+            reinterpret_cast<uintptr_t>(ptr) & ~(AREA_SIZE - 1)
+        );
+    }
+
+    uint8_t* data() noexcept {
+        return reinterpret_cast<uint8_t*>(this) + HEADER_SIZE;
+    }
+
+    /* map `size` bytes aligned to AREA_SIZE following `policy_` */
+    static TlsfArea* map(std::size_t size, TlsfPool* pool) noexcept {
+        auto base = policy_.map(size, AREA_SIZE);
+        if (unlikely(base == nullptr)) {
+            return nullptr;
+        }
+        mapped_.fetch_add(size, std::memory_order_relaxed);
+        auto area = static_cast<TlsfArea*>(base);
+        area->magic_ = AREA_MAGIC;
+        area->huge_ = false;
+        area->size_ = size;
+        area->pool_ = pool;
+        return area;
+    }
+
+    static void unmap(TlsfArea* area) noexcept {
+        mapped_.fetch_sub(area->size_, std::memory_order_relaxed);
+        MemPolicy::unmap(area, area->size_);
+    }
+};
+
+/**
+ * per-thread TLSF pool, only its owner call `malloc_ex`/`free_ex` on it,
+ * so TLSF needs no lock. blocks freed by other threads are pushed onto the
+ * lock-free `remote_` list and given back to TLSF by the owner on its next
+ * allocation.
+ *
+ * pools are never destroyed: the pool of an exited thread is orphaned and
+ * keep collecting remote frees until a new thread adopt it.
+ */
+struct TlsfPool {
+    void* tlsf_ {nullptr};
+    TlsfPool* next_ {nullptr}; /**< next pool of the registry */
+    bool orphaned_ {false};
+    alignas(SQK_CACHE_LINESIZE) std::atomic<TlsfFreeNode*> remote_ {nullptr};
+
+    /* map the first `areas` areas, the TLSF control block sit in the first */
+    bool init(std::size_t areas) noexcept {
+        auto area = TlsfArea::map(TlsfArea::AREA_SIZE, this);
+        if (unlikely(area == nullptr)) {
+            return false;
+        }
+        tlsf_ = area->data();
+        auto free = init_memory_pool(
+            TlsfArea::AREA_SIZE - TlsfArea::HEADER_SIZE,
+            tlsf_
+        );
+        if (unlikely(free == static_cast<std::size_t>(-1))) {
+            TlsfArea::unmap(area);
+            return false;
+        }
+        for (std::size_t i = 1; i < areas; i++) {
+            this->grow();
+        }
+        return true;
+    }
+
+    void* alloc(std::size_t size) noexcept {
+        if (unlikely(remote_.load(std::memory_order_relaxed) != nullptr)) {
+            this->reclaim();
+        }
+        void* ptr = malloc_ex(size, tlsf_);
+        if (unlikely(ptr == nullptr) && this->grow()) {
+            ptr = malloc_ex(size, tlsf_);
+        }
+        return ptr;
+    }
+
+    void free_local(void* ptr) noexcept {
+        free_ex(ptr, tlsf_);
+    }
+
+    void remote_free(void* ptr) noexcept {
+        auto node = static_cast<TlsfFreeNode*>(ptr);
+        node->next_ = remote_.load(std::memory_order_relaxed);
+        while (!remote_.compare_exchange_weak(
+            node->next_,
+            node,
+            std::memory_order_release,
+            std::memory_order_relaxed
+        )) {}
+    }
+
+  private:
+    void reclaim() noexcept {
+        auto node = remote_.exchange(nullptr, std::memory_order_acquire);
+        while (node) {
+            auto next = node->next_;
+            free_ex(node, tlsf_);
+            node = next;
+        }
+    }
+
+    bool grow() noexcept {
+        auto area = TlsfArea::map(TlsfArea::AREA_SIZE, this);
+        if (unlikely(area == nullptr)) {
+            return false;
+        }
+        add_new_area(
+            area->data(),
+            TlsfArea::AREA_SIZE - TlsfArea::HEADER_SIZE,
+            tlsf_
+        );
+        return true;
+    }
+};
+
+static_assert(sizeof(TlsfArea) <= TlsfArea::HEADER_SIZE, "");
+
+thread_local TlsfPool* tpool_;
+thread_local bool exited_;
+std::mutex registry_lock_;
+TlsfPool* pools_;
+
+/**
+ * areas each new pool start with, `COMMON_ALLOCATOR_SIZE_MB` reserve more
+ * up front for threads known to allocate a lot.
+ */
+std::size_t initial_areas() noexcept {
+    static const std::size_t areas = [] {
+        std::size_t bytes = 0;
+        if (const char* mb = getenv("COMMON_ALLOCATOR_SIZE_MB")) {
+            bytes = std::size_t(atoi(mb)) << 20;
+        }
+        return std::max<std::size_t>(
+            ROUNDUP(bytes, TlsfArea::AREA_SIZE) >> TlsfArea::AREA_SHIFT,
+            1
+        );
+    }();
+    return areas;
+}
+
+/**
+ * orphan the pool on thread exit, its areas and free blocks are kept for
+ * the thread adopting it next.
+ */
+void detach() noexcept {
+    auto pool = tpool_;
+    tpool_ = nullptr;
+    exited_ = true;
+    if (pool == nullptr) {
+        return;
+    }
+    std::lock_guard guard(registry_lock_);
+    pool->orphaned_ = true;
+}
+
+/* adopt an orphaned pool or create a new one */
+TlsfPool* attach() noexcept {
+    static thread_local struct Detacher {
+        ~Detacher() {
+            detach();
+        }
+    } detacher;
+    (void)detacher;
+    {
+        std::lock_guard guard(registry_lock_);
+        for (auto pool = pools_; pool; pool = pool->next_) {
+            if (pool->orphaned_) {
+                pool->orphaned_ = false;
+                return tpool_ = pool;
+            }
+        }
+    }
+    auto pool = new (std::nothrow) TlsfPool;
+    if (unlikely(pool == nullptr)) {
+        return nullptr;
+    }
+    if (unlikely(!pool->init(initial_areas()))) {
+        S_ERROR("failed to map tlsf pool");
+        delete pool;
+        return nullptr;
+    }
+    std::lock_guard guard(registry_lock_);
+    pool->next_ = pools_;
+    pools_ = pool;
+    return tpool_ = pool;
+}
+
+TlsfPool* this_pool() noexcept {
+    if (likely(tpool_ != nullptr)) {
+        return tpool_;
+    }
+    if (unlikely(exited_)) {
+        return nullptr;
+    }
+    return attach();
+}
+
+void* huge_alloc(std::size_t size) noexcept {
+    auto area = TlsfArea::map(TlsfArea::HEADER_SIZE + size, nullptr);
+    if (unlikely(area == nullptr)) {
+        return nullptr;
+    }
+    area->huge_ = true;
+    return area->data();
+}
+
+} // namespace
+
 template <bool IsNoExcept>
 void *
 newImpl(std::size_t size) noexcept(IsNoExcept) {
-    void *ptr = tlsf_malloc(size);
+    void *ptr;
+    auto pool = this_pool();
+    if (unlikely(pool == nullptr || size > TlsfArea::HUGE_SIZE)) {
+        ptr = huge_alloc(size);
+    } else {
+        ptr = pool->alloc(size);
+    }
     if constexpr (IsNoExcept) {
         return ptr;
     } else if (ptr) {
@@ -19,7 +268,18 @@ newImpl(std::size_t size) noexcept(IsNoExcept) {
 }
 
 void freeImpl(void* ptr) noexcept {
-    tlsf_free(ptr);
+    if (unlikely(ptr == nullptr)) {
+        return;
+    }
+    auto area = TlsfArea::of(ptr);
+    S_ASSERT(area->magic_ == TlsfArea::AREA_MAGIC);
+    if (unlikely(area->huge_)) {
+        TlsfArea::unmap(area);
+    } else if (likely(area->pool_ == tpool_)) {
+        area->pool_->free_local(ptr);
+    } else {
+        area->pool_->remote_free(ptr);
+    }
 }
 
 void *
@@ -60,6 +320,12 @@ TlsfPoolAllocator::operator delete[](void* ptr, const std::nothrow_t&) noexcept
     return freeImpl(ptr);
 }
 
-} // namespace sqk::common
+void TlsfPoolAllocator::set_mem_policy(const MemPolicy& policy) noexcept {
+    TlsfArea::policy_ = policy;
+}
 
-#endif // !SQK_COMMON_ALLOCATOR_HPP_
+std::size_t TlsfPoolAllocator::mapped() noexcept {
+    return TlsfArea::mapped_.load(std::memory_order_relaxed);
+}
+
+} // namespace sqk::common
@@ -0,0 +1,254 @@
+#ifndef SQK_CHANNEL_HPP
+#define SQK_CHANNEL_HPP
+
+#include <atomic>
+#include <utility>
+
+#include "core.hpp"
+
+namespace sqk {
+
+/**
+ * bounded async channel on a `Ring`, `co_await chan.recv()` suspend while
+ * the ring is empty and `co_await chan.send(v)` suspend while it is full.
+ *
+ * every successful ring operation check `waiting_` after a full fence, and
+ * only then take `lock_` to hand elements between the ring and suspended
+ * awaiters, a suspending awaiter bump `waiting_` before its last retry, so
+ * either side always observe the other and no wakeup is lost. the element
+ * is moved into the receiver's awaiter before it is woken, the woken
+ * coroutine never race other consumers for it. a woken awaiter is enqueued
+ * to the scheduler it suspended on once the lock is released, so the
+ * `try_` side needn't run on a worker.
+ *
+ * any `RingType` with `of`/`free`/`enqueue`/`dequeue` fit, pass a
+ * `common::SlotRing<T>` for non-trivially-copyable `T`.
+ */
+template<
+    typename T,
+    typename RingType =
+        Ring<T, RingSyncType::SQK_RING_SYNC_MT, RingSyncType::SQK_RING_SYNC_MT>>
+struct Channel {
+    struct RecvAwaiter: Awaker<T> {
+        Channel& chan_;
+        RecvAwaiter* next_ {nullptr};
+        SQKScheduler* sched_ {nullptr};
+
+        RecvAwaiter(Channel& chan) : chan_(chan) {}
+
+        // moved into the coroutine frame by `co_await`, never once suspended
+        RecvAwaiter(RecvAwaiter&& other) : chan_(other.chan_) {}
+
+        bool await_ready() {
+            return chan_.try_recv(this->ret_);
+        }
+
+        bool await_suspend(std::coroutine_handle<> handle) {
+            Awaker<T>::await_suspend(handle);
+            sched_ = scheduler;
+            return chan_.suspend(chan_.recv_waiters_, this, [&] {
+                return chan_.ring_->dequeue(this->ret_);
+            });
+        }
+    };
+
+    struct SendAwaiter: Awaker<void> {
+        Channel& chan_;
+        T value_;
+        SendAwaiter* next_ {nullptr};
+        SQKScheduler* sched_ {nullptr};
+
+        SendAwaiter(Channel& chan, T&& value) :
+            chan_(chan),
+            value_(std::move(value)) {}
+
+        SendAwaiter(SendAwaiter&& other) :
+            chan_(other.chan_),
+            value_(std::move(other.value_)) {}
+
+        bool await_ready() {
+            return chan_.try_send(std::move(value_));
+        }
+
+        bool await_suspend(std::coroutine_handle<> handle) {
+            Awaker<void>::await_suspend(handle);
+            sched_ = scheduler;
+            return chan_.suspend(chan_.send_waiters_, this, [&] {
+                return chan_.ring_->enqueue(std::move(value_));
+            });
+        }
+    };
+
+    Channel(uint32_t cnt = 1024) : ring_(RingType::of(cnt)) {}
+
+    Channel(Channel&) = delete;
+    Channel& operator=(Channel&) = delete;
+
+    /* no awaiter may be suspended on the channel anymore */
+    ~Channel() {
+        S_ASSERT(recv_waiters_.empty() && send_waiters_.empty());
+        RingType::free(ring_);
+    }
+
+    RecvAwaiter recv() {
+        return {*this};
+    }
+
+    SendAwaiter send(T value) {
+        return {*this, std::move(value)};
+    }
+
+    /* never suspend, usable outside coroutines and workers */
+    bool try_recv(T& value) {
+        if (ring_->dequeue(value)) {
+            this->balance();
+            return true;
+        }
+        return false;
+    }
+
+    template<typename T2>
+    bool try_send(T2&& value) {
+        if (ring_->enqueue(std::forward<T2>(value))) {
+            this->balance();
+            return true;
+        }
+        return false;
+    }
+
+    uint32_t count() const {
+        return ring_->count();
+    }
+
+  private:
+    template<typename Node>
+    struct WaitList {
+        Node* head_ {nullptr};
+        Node* tail_ {nullptr};
+
+        bool empty() const {
+            return head_ == nullptr;
+        }
+
+        void push(Node* node) {
+            node->next_ = nullptr;
+            if (tail_) {
+                tail_->next_ = node;
+            } else {
+                head_ = node;
+            }
+            tail_ = node;
+        }
+
+        Node* pop() {
+            Node* node = head_;
+            head_ = node->next_;
+            if (head_ == nullptr) {
+                tail_ = nullptr;
+            }
+            return node;
+        }
+    };
+
+    /* waiters taken off the wait lists, not yet enqueued */
+    struct Woken {
+        WaitList<RecvAwaiter> recv_;
+        WaitList<SendAwaiter> send_;
+
+        void wake() {
+            wake(recv_);
+            wake(send_);
+        }
+
+        /* the awaiter may be resumed and gone as soon as enqueued */
+        template<typename Node>
+        static void wake(WaitList<Node>& list) {
+            while (!list.empty()) {
+                Node* node = list.pop();
+                node->sched_->enqueue(node->handle_);
+            }
+        }
+    };
+
+    void lock() {
+        while (lock_.test_and_set(std::memory_order_acquire)) {
+            while (lock_.test(std::memory_order_relaxed)) {
+                sqk_pause();
+            }
+        }
+    }
+
+    void unlock() {
+        lock_.clear(std::memory_order_release);
+    }
+
+    /**
+     * queue `node` unless `retry` succeed under the lock, return whether the
+     * awaiter stay suspended, `node` must not be touched after unlock then
+     * since a waker on another worker may resume it at once.
+     */
+    template<typename Node, typename F>
+    bool suspend(WaitList<Node>& waiters, Node* node, F&& retry) {
+        this->lock();
+        waiting_.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (retry()) {
+            waiting_.fetch_sub(1, std::memory_order_relaxed);
+            Woken woken;
+            this->transfer(woken);
+            this->unlock();
+            woken.wake();
+            return false;
+        }
+        waiters.push(node);
+        this->unlock();
+        return true;
+    }
+
+    void balance() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (likely(waiting_.load(std::memory_order_relaxed) == 0)) {
+            return;
+        }
+        Woken woken;
+        this->lock();
+        this->transfer(woken);
+        this->unlock();
+        woken.wake();
+    }
+
+    /**
+     * move elements between the ring and the waiters until neither side can
+     * make progress, a handoff to a receiver free a slot for a sender and the
+     * other way around. caller must hold the lock, the satisfied waiters
+     * are collected into `woken` to be woken after unlock.
+     */
+    void transfer(Woken& woken) {
+        bool progress = true;
+        while (progress) {
+            progress = false;
+            if (!recv_waiters_.empty()
+                && ring_->dequeue(recv_waiters_.head_->ret_)) {
+                woken.recv_.push(recv_waiters_.pop());
+                waiting_.fetch_sub(1, std::memory_order_relaxed);
+                progress = true;
+            }
+            if (!send_waiters_.empty()
+                && ring_->enqueue(std::move(send_waiters_.head_->value_))) {
+                woken.send_.push(send_waiters_.pop());
+                waiting_.fetch_sub(1, std::memory_order_relaxed);
+                progress = true;
+            }
+        }
+    }
+
+    RingType* ring_;
+    WaitList<RecvAwaiter> recv_waiters_;
+    WaitList<SendAwaiter> send_waiters_;
+    std::atomic_flag lock_ = ATOMIC_FLAG_INIT;
+    SQK_CACHELINE_ALIGNED std::atomic<uint32_t> waiting_ {0};
+};
+
+} // namespace sqk
+
+#endif // !SQK_CHANNEL_HPP
@@ -1,17 +1,38 @@
 #ifndef SQK_CORE_HPP
 #define SQK_CORE_HPP
 
+#ifdef __linux__
+    #include <linux/futex.h>
+    #include <poll.h>
+    #include <pthread.h>
+    #include <sched.h>
+    #include <sys/eventfd.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cerrno>
+#include <atomic>
+#include <chrono>
+#include <concepts>
 #include <coroutine>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <type_traits>
 #include <variant>
+#include <vector>
 
 #include "log.hpp"
 #include "ring.hpp"
 #include "allocator.hpp"
+#include "timer.hpp"
 
 namespace sqk {
 
 template<typename T>
-struct MaybeSuspend;
+struct TaskAwaiter;
 template<typename T>
 struct Promise;
 
@@ -27,46 +48,1085 @@ struct Task: std::coroutine_handle<Promise<T>> {
     using promise_type = Promise<T>;
 };
 
-using sqk::common::MpscRing;
+using sqk::common::Ring;
 using sqk::common::RingGuard;
+using sqk::common::RingSyncType;
+
+struct SQKScheduler;
+struct SQKSchedulerGroup;
+
+/**
+ * scheduler of the current thread, every worker of `SQKSchedulerGroup` set
+ * it to its own scheduler, so `Awaker::wake` and `co_yield` always enqueue
+ * onto the local run queue.
+ */
+static inline thread_local SQKScheduler* scheduler;
+
+inline int pin_thread(int cpu) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+    SQK_SET_USED(cpu);
+    return 0;
+#endif
+}
+
+inline void futex_wait(
+    std::atomic<uint32_t>& addr,
+    uint32_t expected,
+    std::chrono::nanoseconds timeout
+) {
+#ifdef __linux__
+    auto sec = std::chrono::duration_cast<std::chrono::seconds>(timeout);
+    timespec ts {
+        .tv_sec = sec.count(),
+        .tv_nsec = (timeout - sec).count(),
+    };
+    syscall(
+        SYS_futex,
+        &addr,
+        FUTEX_WAIT_PRIVATE,
+        expected,
+        timeout.count() ? &ts : nullptr,
+        nullptr,
+        0
+    );
+#else
+    SQK_SET_USED(timeout);
+    addr.wait(expected);
+#endif
+}
+
+inline void futex_wake(std::atomic<uint32_t>& addr) {
+#ifdef __linux__
+    syscall(SYS_futex, &addr, FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+#else
+    addr.notify_one();
+#endif
+}
+
+/**
+ * what `SQKScheduler::run` does when there is nothing to run: spin with
+ * `sqk_pause` for `spin_` rounds, then `sched_yield` for `yield_` rounds,
+ * then park until woken by an enqueue, a poller's eventfd or
+ * `park_timeout_` elapsed (0 means no timeout, bar pollers without
+ * eventfd). with `trim_` the worker give its free slab pages back before
+ * the first park of an idle period.
+ */
+struct IdlePolicy {
+    uint32_t spin_ {4096};
+    uint32_t yield_ {16};
+    bool park_ {true};
+    std::chrono::nanoseconds park_timeout_ {std::chrono::milliseconds(10)};
+    bool trim_ {true};
+
+    /* the original behavior, burn the core and never sleep */
+    static IdlePolicy busy_poll() {
+        return {.spin_ = UINT32_MAX, .yield_ = 0, .park_ = false};
+    }
+};
+
+/**
+ * a source of completions the scheduler polls itself, e.g. an spdk thread,
+ * a fabric CQ/EQ or an io_uring. `poll_` return whether it found any work,
+ * a poller found idle is skipped for exponentially more rounds, up to
+ * `SQKScheduler::set_poll_skip_max`, until it find work again.
+ *
+ * `fd_` is an eventfd signalled on new completions, if any, a parked worker
+ * is woken by it. pollers without one only let the worker park for short
+ * periods.
+ */
+struct Poller {
+    using PollFn = bool (*)(void*);
+
+    PollFn poll_;
+    void* arg_;
+    int fd_ {-1};
+    uint32_t idle_ {}; /**< consecutive polls without work */
+    uint32_t skip_ {}; /**< rounds left before the next poll */
+};
+
+template<typename P>
+concept Pollable = requires(P& p) {
+    { p.poll() } -> std::convertible_to<int>;
+};
+
+/* a poller able to wake a parked worker, see `Poller::fd_` */
+template<typename P>
+concept Waitable = Pollable<P> && requires(P& p) {
+    { p.wait_fd() } -> std::convertible_to<int>;
+};
+
+/**
+ * a call posted to a scheduler, run by its owner thread only. intrusive,
+ * the sender keep it alive and in place until `fn_` is called, and may
+ * post it again from there.
+ */
+struct SchedulerMsg {
+    using MsgFn = void (*)(void*);
+
+    MsgFn fn_;
+    void* arg_;
+    SchedulerMsg* next_ {};
+};
+
+struct SchedulerStats {
+    uint64_t parks_; /**< times the scheduler went to sleep */
+    uint64_t wakes_; /**< times a sleeping scheduler was woken by enqueue */
+};
 
 struct SQKScheduler {
-    alignas(SQK_CACHE_LINESIZE) bool stopped_ {};
-    RingGuard<MpscRing<std::coroutine_handle<>>> queue_;
+    /* owner dequeue locally, idle peers steal from it */
+    using RunQueue = Ring<
+        std::coroutine_handle<>,
+        RingSyncType::SQK_RING_SYNC_MT,
+        RingSyncType::SQK_RING_SYNC_MT>;
+    /* max handles moved by one steal */
+    static constexpr uint32_t STEAL_BATCH = 32;
+    /* max handles drained from the run queue by one dequeue */
+    static constexpr uint32_t RUN_BATCH_MAX = 64;
+    /* max rounds an idle poller is skipped by default */
+    static constexpr uint32_t POLL_SKIP_MAX_DEF = 64;
+    /* max park with pollers unable to wake the worker and no park timeout */
+    static constexpr std::chrono::milliseconds POLLER_PARK_MAX {10};
+    /* values of `sleeping_` */
+    static constexpr uint32_t PARKED = 1;
+    static constexpr uint32_t PARKED_FDS = 2; /**< in ppoll on `wait_fds_` */
+
+    alignas(SQK_CACHE_LINESIZE) std::atomic<bool> stopped_ {};
+    RingGuard<RunQueue> queue_;
+    /* any thread push, only the owner take them all at once, newest first */
+    std::atomic<SchedulerMsg*> msgs_ {};
+    SQKSchedulerGroup* group_ {};
+    uint32_t id_ {};
+    uint32_t seed_ {0x9e3779b9};
+    IdlePolicy idle_policy_ {};
+    uint32_t run_batch_ {32};
+    bool trimmed_ {};
+    uint32_t poll_ratio_ {1};
+    uint32_t poll_skip_max_ {POLL_SKIP_MAX_DEF};
+    uint32_t rounds_ {};
+    bool pollers_dirty_ {};
+    std::vector<Poller> pollers_;
+    int wake_fd_ {-1}; /**< eventfd waking a worker parked on poller fds */
+    std::vector<pollfd> wait_fds_;
+    TimerWheel timers_;
+    std::atomic<uint64_t> parks_ {};
+    /* written by remote enqueuers */
+    alignas(SQK_CACHE_LINESIZE) std::atomic<uint32_t> sleeping_ {};
+    std::atomic<uint64_t> wakes_ {};
+    /* handles which found the run queue full, moved back by the owner */
+    alignas(SQK_CACHE_LINESIZE) std::atomic<bool> spilled_ {};
+    std::atomic_flag spill_lock_ = ATOMIC_FLAG_INIT;
+    std::vector<std::coroutine_handle<>> spill_;
 
   public:
-    template<typename T>
-    int enqueue(Task<T> handle) {
-        queue_->enqueue(handle);
-        handle.promise().caller_ = std::noop_coroutine(); // enqueue task manual has no caller to co_await
-        return 0;
+    SQKScheduler() {}
+
+    SQKScheduler(SQKSchedulerGroup* group, uint32_t id) :
+        group_(group),
+        id_(id),
+        seed_(0x9e3779b9 ^ (id + 1)) {}
+
+    SQKScheduler(SQKScheduler&) = delete;
+    SQKScheduler& operator=(SQKScheduler&) = delete;
+
+    ~SQKScheduler() {
+#ifdef __linux__
+        if (wake_fd_ >= 0) {
+            close(wake_fd_);
+        }
+#endif
     }
 
+    /**
+     * never drop `handle`, if the run queue is full it is kept on an
+     * overflow list the owner drain as the queue empty, a woken or
+     * yielding coroutine has nowhere else to go.
+     */
     template<typename T>
     int enqueue(T handle) {
-        queue_->enqueue(handle);
+        if (unlikely(push(handle) < 0)) {
+            spill(handle);
+        }
         return 0;
     }
 
+    /* -EAGAIN if the run queue is full, for submitters able to back off */
+    template<typename T>
+    int try_enqueue(T handle) {
+        return push(handle);
+    }
+
     void stop() {
-        stopped_ = 1;
+        stopped_.store(true, std::memory_order_relaxed);
+        notify();
+    }
+
+    void set_idle_policy(IdlePolicy policy) {
+        idle_policy_ = policy;
+    }
+
+    /**
+     * handles taken locally per dequeue, larger batches amortize the ring
+     * atomics, smaller ones leave more work visible to stealing peers
+     */
+    void set_run_batch(uint32_t n) {
+        run_batch_ = std::clamp(n, 1U, RUN_BATCH_MAX);
+    }
+
+    /**
+     * poll `poll(arg)` from the scheduler loop, from the scheduler's own
+     * thread only. its completions don't come with an enqueue, the
+     * scheduler only park once its pollers were idle for
+     * `set_poll_skip_max` rounds, then until the eventfd `fd` is signalled
+     * or, without `fd`, for at most the park timeout.
+     */
+    void add_poller(Poller::PollFn poll, void* arg, int fd = -1) {
+#ifdef __linux__
+        if (fd >= 0 && wake_fd_ < 0) {
+            wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (wake_fd_ < 0) {
+                S_WARN("scheduler {} eventfd: {}", id_, errno);
+            }
+        }
+        if (wake_fd_ < 0) {
+            fd = -1;
+        }
+#else
+        fd = -1;
+#endif
+        pollers_.push_back({.poll_ = poll, .arg_ = arg, .fd_ = fd});
+    }
+
+    /**
+     * poll anything with a `poll()` returning a positive value on work, and
+     * wait on its `wait_fd()` if it has one
+     */
+    template<Pollable P>
+    void add_poller(P& poller) {
+        int fd = -1;
+        if constexpr (Waitable<P>) {
+            fd = poller.wait_fd();
+        }
+        add_poller(
+            [](void* arg) { return static_cast<P*>(arg)->poll() > 0; },
+            &poller,
+            fd
+        );
+    }
+
+    /**
+     * the pollers of `arg` have work pending, e.g. queued submissions, poll
+     * them on the next round even if they were idle and being skipped
+     */
+    void kick_poller(void* arg) {
+        for (auto& poller : pollers_) {
+            if (poller.arg_ == arg) {
+                poller.idle_ = 0;
+                poller.skip_ = 0;
+            }
+        }
+    }
+
+    /* unregister the pollers of `arg`, may be called from a poller */
+    void remove_poller(void* arg) {
+        for (auto& poller : pollers_) {
+            if (poller.arg_ == arg) {
+                poller.poll_ = nullptr;
+                pollers_dirty_ = true;
+            }
+        }
+    }
+
+    /**
+     * run the pollers once every `n` batches of tasks, and on every round
+     * without task. a higher ratio favor throughput of the tasks over
+     * completion latency.
+     */
+    void set_poll_ratio(uint32_t n) {
+        poll_ratio_ = std::max(n, 1U);
+    }
+
+    /* 0 poll idle pollers every round */
+    void set_poll_skip_max(uint32_t rounds) {
+        poll_skip_max_ = rounds;
+    }
+
+    /**
+     * run `msg.fn_(msg.arg_)` on the scheduler's own thread, unlike enqueued
+     * handles messages are never stolen by peers. never fail, the mailbox
+     * is a list of the senders' own messages.
+     */
+    void send_msg(SchedulerMsg& msg) {
+        SchedulerMsg* head = msgs_.load(std::memory_order_relaxed);
+        do {
+            msg.next_ = head;
+        } while (!msgs_.compare_exchange_weak(
+            head,
+            &msg,
+            std::memory_order_release,
+            std::memory_order_relaxed
+        ));
+        notify();
+    }
+
+    /**
+     * arm `timer` to expire `delay` from now, from the scheduler's own
+     * thread only. its `fn_` is then called from the scheduler loop, which
+     * check the wheel against the TSC every round and never park past the
+     * next timer due.
+     */
+    void add_timer(Timer& timer, std::chrono::nanoseconds delay) {
+        timers_.add(&timer, Tsc::now() + Tsc::from_ns(delay));
+    }
+
+    /* a no-op if `timer` already expired */
+    void cancel_timer(Timer& timer) {
+        timers_.cancel(&timer);
+    }
+
+    SchedulerStats stats() const {
+        return {
+            .parks_ = parks_.load(std::memory_order_relaxed),
+            .wakes_ = wakes_.load(std::memory_order_relaxed),
+        };
+    }
+
+    /**
+     * wake the scheduler if it is parked, only remote enqueuers need it,
+     * the owner thread never enqueue while sleeping.
+     */
+    void notify() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleeping_.load(std::memory_order_relaxed) == 0) {
+            return;
+        }
+        uint32_t parked = sleeping_.exchange(0, std::memory_order_relaxed);
+        if (parked) {
+            wakes_.fetch_add(1, std::memory_order_relaxed);
+        }
+        if (parked == PARKED) {
+            futex_wake(sleeping_);
+        } else if (parked == PARKED_FDS) {
+#ifdef __linux__
+            uint64_t one = 1;
+            auto n = write(wake_fd_, &one, sizeof(one));
+            SQK_SET_USED(n);
+#endif
+        }
+    }
+
+    bool stopped() const {
+        return stopped_.load(std::memory_order_relaxed);
+    }
+
+    uint32_t id() const {
+        return id_;
     }
 
     int run() {
-        std::coroutine_handle<> handle;
+        std::coroutine_handle<> batch[RUN_BATCH_MAX];
+        uint32_t idle = 0;
+        scheduler = this;
         for (;;) {
-            if (likely(queue_->dequeue(handle))) {
-                S_DBUG("resume: {}", handle.address());
-                handle.resume();
-                if (unlikely(stopped_)) {
-                    return 0;
+            uint32_t n =
+                queue_->dequeue_burst(std::span(batch, batch_size()));
+            if (unlikely(spilled_.load(std::memory_order_relaxed))) {
+                unspill();
+            }
+            if (n == 0 && steal(batch[0])) {
+                n = 1;
+            }
+            bool polled = unlikely(has_msgs()) && run_msgs();
+            if (timers_.size()) {
+                polled |= timers_.advance(Tsc::now()) > 0;
+            }
+            if (!pollers_.empty() && (n == 0 || ++rounds_ >= poll_ratio_)) {
+                rounds_ = 0;
+                polled |= run_pollers();
+            }
+            if (likely(n)) {
+                idle = 0;
+                trimmed_ = false;
+                if (unlikely(run_batch(batch, n))) {
+                    break;
+                }
+            } else if (unlikely(stopped())) {
+                break;
+            } else if (polled) {
+                idle = 0;
+            } else {
+                idle = on_idle(idle);
+            }
+        }
+        S_DBUG(
+            "scheduler {} quit, parks: {}, wakes: {}",
+            id_,
+            stats().parks_,
+            stats().wakes_
+        );
+        return 0;
+    }
+
+  private:
+    inline bool steal(std::coroutine_handle<>& handle);
+    inline bool has_remote_work() const;
+    inline void wake_peer();
+    inline void enter_group_sleep();
+    inline void leave_group_sleep();
+
+    /* in a group leave at least half of the queue to stealing peers */
+    uint32_t batch_size() {
+        if (!group_) {
+            return run_batch_;
+        }
+        return std::min(run_batch_, (queue_->count() + 1) / 2);
+    }
+
+    /**
+     * resume handles in order, prefetch the next frame while running the
+     * current one. return true if stopped, the handles not yet resumed are
+     * put back to the queue.
+     */
+    bool run_batch(std::coroutine_handle<>* batch, uint32_t n) {
+        for (uint32_t i = 0; i < n; i++) {
+            if (i + 1 < n) {
+                prefetch(batch[i + 1].address());
+            }
+            S_DBUG("resume: {}", batch[i].address());
+            batch[i].resume();
+            if (unlikely(stopped())) {
+                while (++i < n) {
+                    enqueue(batch[i]);
                 }
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * poll every poller not being skipped, return whether any found work.
+     * pollers may resume coroutines which add or remove pollers, so the
+     * vector is walked by index and compacted afterwards.
+     */
+    bool run_pollers() {
+        bool found = false;
+        for (size_t i = 0; i < pollers_.size(); i++) {
+            auto& poller = pollers_[i];
+            if (poller.poll_ == nullptr) {
+                continue;
+            }
+            if (poller.skip_) {
+                poller.skip_--;
+                continue;
+            }
+            bool work = poller.poll_(poller.arg_);
+            // a poller may have grown the vector
+            auto& polled = pollers_[i];
+            if (work) {
+                found = true;
+                polled.idle_ = 0;
+            } else {
+                polled.idle_ = std::min(polled.idle_ + 1, 31U);
+                polled.skip_ =
+                    std::min((1U << (polled.idle_ - 1)) - 1, poll_skip_max_);
+            }
+        }
+        if (unlikely(pollers_dirty_)) {
+            std::erase_if(pollers_, [](const Poller& poller) {
+                return poller.poll_ == nullptr;
+            });
+            pollers_dirty_ = false;
+        }
+        return found;
+    }
+
+    bool has_msgs() const {
+        return msgs_.load(std::memory_order_relaxed) != nullptr;
+    }
+
+    /* run the posted messages in order, those posted meanwhile next round */
+    bool run_msgs() {
+        SchedulerMsg* msg = msgs_.exchange(nullptr, std::memory_order_acquire);
+        SchedulerMsg* ordered = nullptr;
+        while (msg) {
+            SchedulerMsg* next = msg->next_;
+            msg->next_ = ordered;
+            ordered = msg;
+            msg = next;
+        }
+        bool found = ordered != nullptr;
+        while (ordered) {
+            // the message may be freed or posted again by its call
+            SchedulerMsg* next = ordered->next_;
+            ordered->fn_(ordered->arg_);
+            ordered = next;
+        }
+        return found;
+    }
+
+    template<typename T>
+    int push(T handle) {
+        if (unlikely(queue_->enqueue(handle) == 0)) {
+            return -EAGAIN;
+        }
+        if (scheduler != this) {
+            notify();
+        } else if (group_) {
+            wake_peer();
+        }
+        return 0;
+    }
+
+    void spill(std::coroutine_handle<> handle) {
+        this->lock_spill();
+        spill_.push_back(handle);
+        spilled_.store(true, std::memory_order_relaxed);
+        this->unlock_spill();
+        if (scheduler != this) {
+            notify();
+        }
+    }
+
+    /* move spilled handles back in order, as far as the run queue has room */
+    void unspill() {
+        this->lock_spill();
+        uint32_t n = queue_->enqueue_burst(std::span(spill_));
+        spill_.erase(spill_.begin(), spill_.begin() + n);
+        spilled_.store(!spill_.empty(), std::memory_order_relaxed);
+        this->unlock_spill();
+    }
+
+    void lock_spill() {
+        while (spill_lock_.test_and_set(std::memory_order_acquire)) {
+            while (spill_lock_.test(std::memory_order_relaxed)) {
+                sqk_pause();
+            }
+        }
+    }
+
+    void unlock_spill() {
+        spill_lock_.clear(std::memory_order_release);
+    }
+
+    uint32_t on_idle(uint32_t idle) {
+        const IdlePolicy& policy = idle_policy_;
+        if (idle < policy.spin_) {
+            sqk_pause();
+        } else if (idle - policy.spin_ < policy.yield_) {
+            std::this_thread::yield();
+        } else if (policy.park_
+                   && (pollers_.empty()
+                       || idle - policy.spin_ - policy.yield_
+                           >= poll_skip_max_)) {
+            if (policy.trim_ && !trimmed_) {
+                common::SlabPoolAllocator::trim();
+                trimmed_ = true;
+            }
+            park();
+            return 0;
+        } else {
+            sqk_pause();
+            // count the rounds the pollers stay idle before parking
+            return policy.park_ ? idle + 1 : idle;
+        }
+        return idle + 1;
+    }
+
+    /**
+     * publish `sleeping_` before the last check of the queues, enqueuers
+     * publish the entry before checking `sleeping_`, so one of them must
+     * see the other.
+     */
+    void park() {
+        enter_group_sleep();
+        bool fds = this->collect_wait_fds();
+        sleeping_.store(fds ? PARKED_FDS : PARKED, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (queue_->empty() && !has_msgs() && !stopped()
+            && !spilled_.load(std::memory_order_relaxed)
+            && !has_remote_work()) {
+            parks_.fetch_add(1, std::memory_order_relaxed);
+            if (fds) {
+                this->wait_fds(park_timeout());
+            } else {
+                futex_wait(sleeping_, PARKED, park_timeout());
             }
         }
+        sleeping_.store(0, std::memory_order_relaxed);
+        leave_group_sleep();
+        // completions may have come meanwhile, poll everything next round
+        for (auto& poller : pollers_) {
+            poller.idle_ = 0;
+            poller.skip_ = 0;
+        }
+    }
+
+    /**
+     * gather `wake_fd_` and the fds of the pollers into `wait_fds_`, false
+     * if no poller has one, the worker then park on the futex.
+     */
+    bool collect_wait_fds() {
+        wait_fds_.clear();
+        for (auto& poller : pollers_) {
+            if (poller.poll_ && poller.fd_ >= 0) {
+                wait_fds_.push_back({.fd = poller.fd_, .events = POLLIN});
+            }
+        }
+        if (wait_fds_.empty()) {
+            return false;
+        }
+        wait_fds_.push_back({.fd = wake_fd_, .events = POLLIN});
+        return true;
+    }
+
+    /* park until a fd is signalled or `timeout`, then reset the eventfds */
+    void wait_fds(std::chrono::nanoseconds timeout) {
+#ifdef __linux__
+        auto sec = std::chrono::duration_cast<std::chrono::seconds>(timeout);
+        timespec ts {
+            .tv_sec = sec.count(),
+            .tv_nsec = (timeout - sec).count(),
+        };
+        int n = ppoll(
+            wait_fds_.data(),
+            wait_fds_.size(),
+            timeout.count() ? &ts : nullptr,
+            nullptr
+        );
+        for (auto& fd : wait_fds_) {
+            if (n > 0 && fd.revents & POLLIN) {
+                uint64_t count;
+                auto rc = read(fd.fd, &count, sizeof(count));
+                SQK_SET_USED(rc);
+            }
+        }
+#else
+        SQK_SET_USED(timeout);
+#endif
+    }
+
+    /* a poller would not wake the worker parked */
+    bool has_blind_poller() const {
+        return std::any_of(pollers_.begin(), pollers_.end(), [](auto& p) {
+            return p.poll_ && p.fd_ < 0;
+        });
+    }
+
+    /**
+     * the idle policy's park timeout, cut short by the next timer due, and
+     * bounded while pollers could not wake the worker
+     */
+    std::chrono::nanoseconds park_timeout() const {
+        auto timeout = idle_policy_.park_timeout_;
+        if (timeout.count() == 0 && has_blind_poller()) {
+            timeout = POLLER_PARK_MAX;
+        }
+        if (uint64_t due = timers_.next_due(Tsc::now())) {
+            auto until =
+                std::max(Tsc::to_ns(due), std::chrono::nanoseconds(1));
+            if (timeout.count() == 0 || until < timeout) {
+                timeout = until;
+            }
+        }
+        return timeout;
+    }
+
+    /**
+     * take half of the victim's queue (at most `STEAL_BATCH`), the first
+     * one is returned to run immediately, the rest go to local queue
+     */
+    bool steal_from(SQKScheduler& victim, std::coroutine_handle<>& handle) {
+        uint32_t n = victim.queue_->count();
+        if (n == 0) {
+            return false;
+        }
+        std::coroutine_handle<> stolen[STEAL_BATCH];
+        n = std::min({(n + 1) / 2, STEAL_BATCH, queue_->free_count() + 1});
+        n = victim.queue_->dequeue_burst(std::span(stolen, n));
+        if (n == 0) {
+            return false;
+        }
+        handle = stolen[0];
+        uint32_t queued = 1 + queue_->enqueue_burst(std::span(stolen + 1, n - 1));
+        // remote enqueuers may have taken the free space meanwhile, hand the
+        // rest back to the victim rather than dropping them
+        while (unlikely(queued < n)) {
+            queued += victim.queue_->enqueue_burst(
+                std::span(stolen + queued, n - queued)
+            );
+            if (queued < n) {
+                sqk_pause();
+                queued +=
+                    queue_->enqueue_burst(std::span(stolen + queued, n - queued));
+            }
+        }
+        S_DBUG("steal: {} <- {}, n={}", id_, victim.id_, n);
+        return true;
+    }
+
+    uint32_t next_random() {
+        seed_ ^= seed_ << 13;
+        seed_ ^= seed_ >> 17;
+        seed_ ^= seed_ << 5;
+        return seed_;
     }
 };
 
-static inline SQKScheduler* scheduler;
+/**
+ * a set of per-core schedulers, every worker thread owns one run queue and
+ * is pinned to one cpu, workers with empty queue steal from busy peers.
+ *
+ * tasks created outside of the workers are submitted with `spawn`, which
+ * distributes them round robin.
+ */
+struct SQKSchedulerGroup {
+    explicit SQKSchedulerGroup(
+        uint32_t nr_workers = std::thread::hardware_concurrency(),
+        std::vector<int> cpus = {}
+    ) :
+        cpus_(std::move(cpus)) {
+        S_ASSERT(nr_workers > 0);
+        workers_.reserve(nr_workers);
+        for (uint32_t i = 0; i < nr_workers; i++) {
+            workers_.emplace_back(std::make_unique<SQKScheduler>(this, i));
+        }
+    }
+
+    SQKSchedulerGroup(const SQKSchedulerGroup&) = delete;
+    SQKSchedulerGroup& operator=(const SQKSchedulerGroup&) = delete;
+
+    ~SQKSchedulerGroup() {
+        stop();
+        join();
+    }
+
+    uint32_t size() const {
+        return workers_.size();
+    }
+
+    SQKScheduler& worker(uint32_t id) {
+        return *workers_[id];
+    }
+
+    /* -EAGAIN if the worker's run queue is full, the task is not started */
+    template<typename T>
+    int spawn(Task<T> task) {
+        uint32_t id = next_.fetch_add(1, std::memory_order_relaxed);
+        return spawn_on(id % size(), task);
+    }
+
+    template<typename T>
+    int spawn_on(uint32_t id, Task<T> task) {
+        return workers_[id]->try_enqueue(task);
+    }
+
+    void start() {
+        unsigned ncpu = std::max(1U, std::thread::hardware_concurrency());
+        for (uint32_t i = 0; i < size(); i++) {
+            int cpu = i < cpus_.size() ? cpus_[i] : i % ncpu;
+            threads_.emplace_back([this, i, cpu]() {
+                if (int rc = pin_thread(cpu)) {
+                    S_WARN("pin worker {} to cpu {}: {}", i, cpu, rc);
+                }
+                workers_[i]->run();
+            });
+        }
+    }
+
+    void stop() {
+        for (auto& worker : workers_) {
+            worker->stop();
+        }
+    }
+
+    void set_idle_policy(IdlePolicy policy) {
+        for (auto& worker : workers_) {
+            worker->set_idle_policy(policy);
+        }
+    }
+
+    SchedulerStats stats() const {
+        SchedulerStats stats {};
+        for (auto& worker : workers_) {
+            auto s = worker->stats();
+            stats.parks_ += s.parks_;
+            stats.wakes_ += s.wakes_;
+        }
+        return stats;
+    }
+
+    void join() {
+        threads_.clear();
+    }
+
+  private:
+    friend struct SQKScheduler;
+
+    std::vector<std::unique_ptr<SQKScheduler>> workers_;
+    std::vector<int> cpus_;
+    std::vector<std::jthread> threads_;
+    std::atomic<uint32_t> next_ {};
+    /* number of parked workers */
+    alignas(SQK_CACHE_LINESIZE) std::atomic<uint32_t> sleepers_ {};
+};
+
+inline bool SQKScheduler::steal(std::coroutine_handle<>& handle) {
+    if (!group_) {
+        return false;
+    }
+    uint32_t n = group_->size();
+    uint32_t start = next_random() % n;
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t victim = (start + i) % n;
+        if (victim != id_ && steal_from(*group_->workers_[victim], handle)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+inline bool SQKScheduler::has_remote_work() const {
+    if (!group_) {
+        return false;
+    }
+    for (auto& worker : group_->workers_) {
+        if (!worker->queue_->empty()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+inline void SQKScheduler::enter_group_sleep() {
+    if (group_) {
+        group_->sleepers_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+inline void SQKScheduler::leave_group_sleep() {
+    if (group_) {
+        group_->sleepers_.fetch_sub(1, std::memory_order_relaxed);
+    }
+}
+
+/* the owner has surplus work, let one sleeping peer come to steal it */
+inline void SQKScheduler::wake_peer() {
+    if (likely(group_->sleepers_.load(std::memory_order_relaxed) == 0)
+        || queue_->count() <= 1) {
+        return;
+    }
+    for (auto& worker : group_->workers_) {
+        if (worker->sleeping_.load(std::memory_order_relaxed)) {
+            worker->notify();
+            return;
+        }
+    }
+}
+
+/**
+ * `co_await resume_on(worker)` continue the coroutine on `worker`, and it
+ * stay there until it suspend again, e.g. to set up per-worker state such
+ * as an SPDK thread.
+ */
+struct ResumeOn {
+    SQKScheduler& worker_;
+    SchedulerMsg msg_ {}; /**< in the suspended frame until resumed */
+
+    bool await_ready() const noexcept {
+        return scheduler == &worker_;
+    }
+
+    void await_suspend(std::coroutine_handle<> handle) noexcept {
+        msg_.fn_ = [](void* arg) {
+            std::coroutine_handle<>::from_address(arg).resume();
+        };
+        msg_.arg_ = handle.address();
+        worker_.send_msg(msg_);
+    }
+
+    void await_resume() const noexcept {}
+};
+
+inline ResumeOn resume_on(SQKScheduler& worker) {
+    return {worker};
+}
+
+/**
+ * cancellation of a task and every task it awaits, see `with_timeout`.
+ * the awaiters able to abort their operation, those with a `cancel()`,
+ * register with the scope of the awaiting task while suspended, so that
+ * `cancel` reach whichever is pending at the time. a cancel is always
+ * carried out on the worker which suspended the awaiter, by a message if
+ * requested from another thread, and an awaiter suspending in a cancelled
+ * scope is cancelled by a message to its worker once suspended.
+ *
+ * `cancel()` of an awaiter must only request the abort, the operation then
+ * complete as usual, typically with -ECANCELED, from the scheduler loop.
+ * awaiters without `cancel()` (`Awaker`, blob IO) just run to completion.
+ */
+struct CancelScope {
+    using CancelFn = void (*)(void*);
+
+    CancelScope() {}
+
+    CancelScope(CancelScope&) = delete;
+    CancelScope& operator=(CancelScope&) = delete;
+
+    /* may be called from any thread */
+    void cancel() {
+        this->lock();
+        cancelled_ = true;
+        SQKScheduler* remote = nullptr;
+        if (fn_ && worker_ == scheduler) {
+            fn_(awaiter_);
+        } else if (fn_ && !posted_) {
+            remote = worker_;
+            posted_ = true;
+        }
+        this->unlock();
+        if (remote) {
+            remote->send_msg(msg_);
+        }
+    }
+
+    bool cancelled() {
+        this->lock();
+        bool cancelled = cancelled_;
+        this->unlock();
+        return cancelled;
+    }
+
+    /* a cancel message is still to be run, the scope must outlive it */
+    bool busy() {
+        this->lock();
+        bool busy = posted_;
+        this->unlock();
+        return busy;
+    }
+
+    /**
+     * register the pending awaiter, about to suspend on this worker. true
+     * if the scope is already cancelled, then `post_cancel` once suspended.
+     */
+    bool enter(CancelFn fn, void* awaiter) {
+        this->lock();
+        fn_ = fn;
+        awaiter_ = awaiter;
+        worker_ = scheduler;
+        bool post = cancelled_ && !posted_;
+        posted_ |= post;
+        this->unlock();
+        return post;
+    }
+
+    /**
+     * cancel the awaiter from the scheduler loop, the awaiter may be
+     * resumed and gone as soon as it suspended, only the message still
+     * check whether it is pending.
+     */
+    void post_cancel() {
+        scheduler->send_msg(msg_);
+    }
+
+    void leave() {
+        this->lock();
+        fn_ = nullptr;
+        this->unlock();
+    }
+
+  private:
+    /**
+     * the awaiter may have completed meanwhile, or another one be pending
+     * on another worker, where the message then go on.
+     */
+    static void cancel_msg(void* arg) {
+        auto scope = static_cast<CancelScope*>(arg);
+        scope->lock();
+        SQKScheduler* next = nullptr;
+        if (scope->fn_ && scope->worker_ == scheduler) {
+            scope->fn_(scope->awaiter_);
+        } else if (scope->fn_) {
+            next = scope->worker_;
+        }
+        scope->posted_ = next != nullptr;
+        scope->unlock();
+        if (next) {
+            next->send_msg(scope->msg_);
+        }
+    }
+
+    void lock() {
+        while (lock_.test_and_set(std::memory_order_acquire)) {
+            sqk_pause();
+        }
+    }
+
+    void unlock() {
+        lock_.clear(std::memory_order_release);
+    }
+
+    std::atomic_flag lock_ {};
+    bool cancelled_ {};
+    bool posted_ {}; /**< `msg_` not run yet */
+    SchedulerMsg msg_ {cancel_msg, this};
+    CancelFn fn_ {}; /**< cancel of the pending awaiter */
+    void* awaiter_ {};
+    SQKScheduler* worker_ {}; /**< where the awaiter was suspended */
+};
+
+template<typename A>
+concept Cancellable = requires(A& awaiter) {
+    awaiter.await_ready();
+    awaiter.cancel();
+};
+
+/* register a cancellable awaiter with the scope of the awaiting task */
+template<Cancellable A>
+struct ScopedAwaiter {
+    A& awaiter_;
+    CancelScope* scope_;
+
+    bool await_ready() {
+        return awaiter_.await_ready();
+    }
+
+    /* neither the awaiter nor `this` may be touched once suspended */
+    auto await_suspend(std::coroutine_handle<> handle) {
+        CancelScope* scope = scope_;
+        bool cancelled = scope && scope->enter(cancel, &awaiter_);
+        using Ret = decltype(awaiter_.await_suspend(handle));
+        if constexpr (std::is_void_v<Ret>) {
+            awaiter_.await_suspend(handle);
+            if (unlikely(cancelled)) {
+                scope->post_cancel();
+            }
+        } else {
+            Ret ret = awaiter_.await_suspend(handle);
+            if (unlikely(cancelled)) {
+                scope->post_cancel();
+            }
+            return ret;
+        }
+    }
+
+    decltype(auto) await_resume() {
+        if (scope_) {
+            scope_->leave();
+        }
+        return awaiter_.await_resume();
+    }
+
+  private:
+    static void cancel(void* awaiter) {
+        static_cast<A*>(awaiter)->cancel();
+    }
+};
 
 struct Awaker_Base {
     std::coroutine_handle<> handle_ {nullptr};
@@ -107,6 +1167,8 @@ struct Awaker: Awaker_Base {
             fmt::ptr(handle_.address()),
             fmt::ptr(&ret)
         );
+        // publish the result before the handle, a worker may resume it at once
+        ret_ = std::move(ret);
         if (handle_) {
             S_DBUG(
                 "enqueue: {}, {}",
@@ -115,7 +1177,6 @@ struct Awaker: Awaker_Base {
             );
             scheduler->enqueue(handle_);
         }
-        ret_ = std::move(ret);
     }
 };
 
@@ -182,21 +1243,41 @@ struct CheckableAwaker<void>: Awaker<void>, CheckableAwaker_Base {
     }
 };
 
+/**
+ * TaskAwaiter start the awaited task by symmetric transfer, the task
+ * transfer back to the awaiter on its final suspend point, so nested
+ * `co_await` chains run in constant native stack space.
+ *
+ * the awaited task always stop at its final suspend point, and is destroyed
+ * by `await_resume` after the result was taken.
+ */
 template<typename T>
-struct MaybeSuspend_Base {
+struct TaskAwaiter_Base {
     Promise<T>& promise_;
-    bool await_ready() const noexcept;
 
-    void await_suspend(std::coroutine_handle<> handle) noexcept {}
+    constexpr bool await_ready() const noexcept {
+        return false;
+    }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller
+    ) noexcept {
+        S_DBUG(
+            "await_suspend: {} -> {}",
+            caller.address(),
+            promise_.get_return_object().address()
+        );
+        promise_.caller_ = caller;
+        return promise_.get_return_object();
+    }
 
-    MaybeSuspend_Base(Promise<T>& promise) : promise_(promise) {}
+    TaskAwaiter_Base(Promise<T>& promise) : promise_(promise) {}
 };
 
 template<typename T>
-struct MaybeSuspend: MaybeSuspend_Base<T> {
-    T&& await_resume();
+struct TaskAwaiter: TaskAwaiter_Base<T> {
+    T await_resume();
 
-    MaybeSuspend(Promise<T>& promise) : MaybeSuspend_Base<T>(promise) {}
+    TaskAwaiter(Promise<T>& promise) : TaskAwaiter_Base<T>(promise) {}
 };
 
 struct SuspendYield {
@@ -212,30 +1293,36 @@ struct SuspendYield {
 };
 
 template<>
-struct MaybeSuspend<void>: MaybeSuspend_Base<void> {
+struct TaskAwaiter<void>: TaskAwaiter_Base<void> {
     void await_resume() const;
 
-    MaybeSuspend(Promise<void>& promise) : MaybeSuspend_Base<void>(promise) {}
+    TaskAwaiter(Promise<void>& promise) : TaskAwaiter_Base<void>(promise) {}
 };
 
 /**
- * FinalSuspend aim to ensure all coro suspend at least once
- *
- * if `Task` has no caller_, it imply that this coro has run complete on await_transform
- *
- * if it was submit to scheduler directly, it's caller_ will be noop_coroutine
+ * FinalSuspend transfer to the awaiting coroutine if there is one, the
+ * awaiter then destroy this coro after taking the result.
  *
+ * a task submitted to scheduler directly has no caller, nobody will read
+ * its result, so it destroy itself.
  */
 struct FinalSuspend {
-    bool ready_;
-
-    FinalSuspend(bool ready) : ready_(ready) {}
+    std::coroutine_handle<> caller_;
 
-    bool await_ready() const noexcept {
-        return ready_;
+    constexpr bool await_ready() const noexcept {
+        return false;
     }
 
-    [[gnu::always_inline]] constexpr void await_suspend(std::coroutine_handle<>) const noexcept {}
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> self
+    ) const noexcept {
+        if (caller_) {
+            S_DBUG("resume_caller: {}", caller_.address());
+            return caller_;
+        }
+        S_DBUG("caller=null {}", self.address());
+        self.destroy();
+        return std::noop_coroutine();
+    }
 
     constexpr void await_resume() const noexcept {}
 };
@@ -257,7 +1344,7 @@ struct PromiseBase: public common::PoolAllocatable<common::SlabPoolAllocator> {
 
     FinalSuspend final_suspend() noexcept {
         S_DBUG("final_suspend: {}", get_return_object().address());
-        return this->resume_caller();
+        return {caller_};
     }
 
     SuspendYield yield_value(std::nullptr_t) {
@@ -265,46 +1352,29 @@ struct PromiseBase: public common::PoolAllocatable<common::SlabPoolAllocator> {
     }
 
     template<typename T2>
-    MaybeSuspend<T2> await_transform(Task<T2> task) {
-        S_DBUG("task resume: {}", task.address());
+    TaskAwaiter<T2> await_transform(Task<T2> task) {
         S_ASSERT(task.promise().caller_ == nullptr);
-        task.resume(); // do (initial_suspend, first_suspend)
-        if (!task.done()) { // exist suspend on coro body
-            task.promise().caller_ = get_return_object();
-        }
-        S_DBUG(
-            "await_transform: {}, done?={}, self: {}",
-            task.address(),
-            task.done(),
-            get_return_object().address()
-        );
-        return MaybeSuspend(task.promise());
+        task.promise().scope_ = scope_;
+        return TaskAwaiter(task.promise());
     }
 
     template</*typename T2, */ typename T1>
-    T1& await_transform(T1& task) /*requires Awakable<T2, T1>*/ {
-        return task;
+    T1&& await_transform(T1&& task) /*requires Awakable<T2, T1>*/ {
+        return std::forward<T1>(task);
     }
 
-    Task<T> get_return_object() {
-        return {Task<T>::from_promise(*static_cast<S*>(this))};
+    template<typename T1>
+        requires Cancellable<std::remove_reference_t<T1>>
+    ScopedAwaiter<std::remove_reference_t<T1>> await_transform(T1&& awaiter) {
+        return {awaiter, scope_};
     }
 
-    bool resume_caller() {
-        if (this->caller_.address() != nullptr) {
-            S_DBUG("resume_caller: {}", this->caller_.address());
-            this->caller_.resume();
-            // caller has resumed explicit; this coro can be destroyed
-            // immediatly
-            return true;
-        } else {
-            S_DBUG("caller=null {}", this->get_return_object().address());
-            // there is no caller,
-            return false;
-        }
+    Task<T> get_return_object() {
+        return {Task<T>::from_promise(*static_cast<S*>(this))};
     }
 
     std::coroutine_handle<> caller_ {nullptr};
+    CancelScope* scope_ {nullptr}; /**< inherited from the awaiting task */
 };
 
 template<typename T>
@@ -339,53 +1409,143 @@ struct Promise<void>: PromiseBase<void, Promise<void>> {
 };
 
 template<typename T>
-inline bool MaybeSuspend_Base<T>::await_ready() const noexcept {
-    S_DBUG(
-        "await_ready hdl: {}, done={}",
-        promise_.get_return_object().address(),
-        promise_.get_return_object().done()
-    );
-    return promise_.get_return_object().done();
-}
-
-template<typename T>
-inline T&& MaybeSuspend<T>::await_resume() {
-    S_DBUG(
-        "await_resume hdl: {}, done={}",
-        this->promise_.get_return_object().address(),
-        this->promise_.get_return_object().done()
-    );
+inline T TaskAwaiter<T>::await_resume() {
+    auto task = this->promise_.get_return_object();
+    S_DBUG("await_resume hdl: {}, done={}", task.address(), task.done());
     if (likely(std::holds_alternative<T>(this->promise_.result_))) {
-        T&& ret = std::move(std::get<T>(this->promise_.result_));
-        // caller is null means this coro was directly resumed on co_await,
-        // and now it was in final_suspend point,
-        // in this case, we should call destroy explicit
-        if (!this->promise_.caller_) {
-            this->promise_.get_return_object().destroy();
-        }
-        return std::move(ret);
+        T ret = std::move(std::get<T>(this->promise_.result_));
+        task.destroy();
+        return ret;
     } else {
         auto except = std::get<std::exception_ptr>(this->promise_.result_);
-        if (!this->promise_.caller_) {
-            this->promise_.get_return_object().destroy();
-        }
+        task.destroy();
         std::rethrow_exception(except);
     }
 }
 
-inline void MaybeSuspend<void>::await_resume() const {
+inline void TaskAwaiter<void>::await_resume() const {
     std::exception_ptr except = this->promise_.result_;
-    if (!this->promise_.caller_) {
-        promise_.get_return_object().destroy();
-    }
+    promise_.get_return_object().destroy();
     if (unlikely(except.operator bool())) {
         std::rethrow_exception(except);
     }
 }
 
-template<>
-inline bool MaybeSuspend_Base<void>::await_ready() const noexcept {
-    return promise_.get_return_object().done();
+/**
+ * `co_await sleep_for(delay)` suspend for at least `delay`, on the timer
+ * wheel of the current worker, and resume from its scheduler loop.
+ * cancelling it wake the coroutine early.
+ */
+struct SleepFor: Timer {
+    explicit SleepFor(std::chrono::nanoseconds delay) :
+        Timer(expire),
+        delay_(delay) {}
+
+    bool await_ready() const noexcept {
+        return delay_.count() <= 0;
+    }
+
+    void await_suspend(std::coroutine_handle<> handle) {
+        handle_ = handle;
+        scheduler->add_timer(*this, delay_);
+    }
+
+    void await_resume() const noexcept {}
+
+    void cancel() {
+        if (this->armed()) {
+            scheduler->cancel_timer(*this);
+            scheduler->enqueue(handle_);
+        }
+    }
+
+  private:
+    static void expire(Timer* timer) {
+        static_cast<SleepFor*>(timer)->handle_.resume();
+    }
+
+    std::chrono::nanoseconds delay_;
+    std::coroutine_handle<> handle_ {};
+};
+
+inline SleepFor sleep_for(std::chrono::nanoseconds delay) {
+    return SleepFor(delay);
+}
+
+/* await `task` in `scope` rather than the scope of the awaiting task */
+template<typename T>
+struct ScopedTask: TaskAwaiter<T> {
+    ScopedTask(Task<T> task, CancelScope& scope) :
+        TaskAwaiter<T>(task.promise()),
+        scope_(scope) {
+        task.promise().scope_ = &scope;
+    }
+
+    /* a cancel of the outer scope cancel the inner one */
+    void cancel() {
+        scope_.cancel();
+    }
+
+    CancelScope& scope_;
+};
+
+/* cancel a scope once its deadline passed */
+struct DeadlineTimer: Timer {
+    explicit DeadlineTimer(CancelScope& scope) :
+        Timer(expire),
+        scope_(scope) {}
+
+    static void expire(Timer* timer) {
+        static_cast<DeadlineTimer*>(timer)->scope_.cancel();
+    }
+
+    CancelScope& scope_;
+};
+
+/**
+ * run `task` with a deadline `timeout` from now. past it the operation the
+ * task is suspended on is cancelled, see `CancelScope`, and the result is
+ * dropped: return the task's result, or nullopt (false for a void task)
+ * if it timed out, an exception of a task which timed out is dropped too.
+ *
+ * the task always finish before `with_timeout` return, a task suspended on
+ * an awaiter which cannot be cancelled is only abandoned once it resume.
+ */
+template<typename T>
+Task<std::conditional_t<std::is_void_v<T>, bool, std::optional<T>>>
+with_timeout(Task<T> task, std::chrono::nanoseconds timeout) {
+    CancelScope scope;
+    DeadlineTimer deadline(scope);
+    SQKScheduler& worker = *scheduler;
+    worker.add_timer(deadline, timeout);
+
+    std::conditional_t<std::is_void_v<T>, bool, std::optional<T>> result {};
+    std::exception_ptr except;
+    try {
+        if constexpr (std::is_void_v<T>) {
+            co_await ScopedTask<T>(task, scope);
+            result = true;
+        } else {
+            result = co_await ScopedTask<T>(task, scope);
+        }
+    } catch (...) {
+        except = std::current_exception();
+    }
+    bool timed_out = scope.cancelled();
+
+    // the wheel belong to the worker which armed the deadline
+    co_await resume_on(worker);
+    worker.cancel_timer(deadline);
+    while (scope.busy()) {
+        co_yield nullptr;
+    }
+    if (timed_out) {
+        co_return {};
+    }
+    if (except) {
+        std::rethrow_exception(except);
+    }
+    co_return std::move(result);
 }
 
 } // namespace sqk
@@ -0,0 +1,274 @@
+#ifndef SQK_CORE_TIMER_HPP
+#define SQK_CORE_TIMER_HPP
+
+#if defined(__x86_64__) || defined(__i386__)
+    #include <x86intrin.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <utility>
+
+#include "log.hpp"
+
+namespace sqk {
+
+/**
+ * the cpu timestamp counter, read without a syscall nor a fence. assume an
+ * invariant TSC, i.e. ticking at a constant rate and synchronized across
+ * cores, as on any x86 of the last decade. the rate is calibrated against
+ * `steady_clock` on first use. other architectures count steady_clock
+ * nanoseconds instead.
+ */
+struct Tsc {
+    static uint64_t now() noexcept {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+    }
+
+    static uint64_t from_ns(std::chrono::nanoseconds ns) noexcept {
+        return std::max<int64_t>(ns.count(), 0) * ticks_per_ns();
+    }
+
+    static std::chrono::nanoseconds to_ns(uint64_t ticks) noexcept {
+        return std::chrono::nanoseconds(int64_t(ticks / ticks_per_ns()));
+    }
+
+    static double ticks_per_ns() noexcept {
+        static const double rate = calibrate();
+        return rate;
+    }
+
+  private:
+    static double calibrate() noexcept {
+#if defined(__x86_64__) || defined(__i386__)
+        using clock = std::chrono::steady_clock;
+        auto start = clock::now();
+        uint64_t tsc = now();
+        std::chrono::nanoseconds elapsed;
+        do {
+            elapsed = clock::now() - start;
+        } while (elapsed < std::chrono::milliseconds(5));
+        return double(now() - tsc) / elapsed.count();
+#else
+        return 1;
+#endif
+    }
+};
+
+/**
+ * a timer of a `TimerWheel`, `fn_` is called from the scheduler loop once
+ * it expired. intrusive, the owner keep it alive and in place while armed.
+ */
+struct Timer {
+    using TimerFn = void (*)(Timer*);
+
+    explicit Timer(TimerFn fn) : fn_(fn) {}
+
+    Timer(Timer&) = delete;
+    Timer& operator=(Timer&) = delete;
+
+    bool armed() const {
+        return pprev_ != nullptr;
+    }
+
+    TimerFn fn_;
+    uint64_t expires_ {}; /**< in wheel ticks */
+    Timer* next_ {};
+    Timer** pprev_ {};
+};
+
+/**
+ * hierarchical timing wheel: LEVELS wheels of SLOTS slots, a slot of level
+ * n spanning SLOTS^n ticks of 2^TICK_SHIFT TSC cycles (about 1us). a timer
+ * go into the coarsest level its delay need, and is cascaded down a level
+ * when the wheel reach the first tick of its slot. adding, cancelling and
+ * expiring are O(1), delays beyond the top level (about an hour) are
+ * clamped to it.
+ *
+ * a bitmap of the occupied slots of each level tell the next tick having a
+ * slot to expire or cascade, the wheel jump straight to it and a worker
+ * park until then, however far.
+ */
+struct TimerWheel {
+    static constexpr uint32_t TICK_SHIFT = 12;
+    static constexpr uint32_t SLOT_BITS = 8;
+    static constexpr uint32_t SLOTS = 1U << SLOT_BITS;
+    static constexpr uint32_t LEVELS = 4;
+    static constexpr uint64_t MAX_DELAY = (1UL << (SLOT_BITS * LEVELS)) - 1;
+
+    explicit TimerWheel(uint64_t now = Tsc::now()) : now_(now >> TICK_SHIFT) {}
+
+    TimerWheel(TimerWheel&) = delete;
+    TimerWheel& operator=(TimerWheel&) = delete;
+
+    /* arm `timer` to expire at TSC `deadline`, at once if already passed */
+    void add(Timer* timer, uint64_t deadline) {
+        S_ASSERT(!timer->armed());
+        timer->expires_ = std::clamp(
+            deadline >> TICK_SHIFT,
+            now_ + 1,
+            now_ + MAX_DELAY
+        );
+        this->link(timer);
+        size_++;
+    }
+
+    void cancel(Timer* timer) {
+        if (timer->armed()) {
+            this->unlink(timer);
+            size_--;
+        }
+    }
+
+    /* expire the timers due by TSC `now`, return how many */
+    uint32_t advance(uint64_t now) {
+        uint64_t target = now >> TICK_SHIFT;
+        uint32_t fired = 0;
+        while (now_ < target) {
+            uint64_t tick = size_ ? this->next_tick() : target;
+            if (tick > target) {
+                now_ = target;
+                break;
+            }
+            now_ = tick;
+            for (uint32_t level = 1; level < LEVELS; level++) {
+                if (now_ & ((1UL << (SLOT_BITS * level)) - 1)) {
+                    break;
+                }
+                this->cascade(level);
+            }
+            auto& slot = slots_[0][now_ & (SLOTS - 1)];
+            // one by one, an expiring timer may cancel another of the slot
+            while (Timer* timer = slot) {
+                this->unlink(timer);
+                size_--;
+                timer->fn_(timer);
+                fired++;
+            }
+        }
+        return fired;
+    }
+
+    /**
+     * TSC cycles until the wheel has to expire or cascade timers, an upper
+     * bound to sleep for. 0 if none is armed.
+     */
+    uint64_t next_due(uint64_t now) const {
+        if (size_ == 0) {
+            return 0;
+        }
+        uint64_t due = this->next_tick() << TICK_SHIFT;
+        return due > now ? due - now : 1;
+    }
+
+    uint32_t size() const {
+        return size_;
+    }
+
+  private:
+    static constexpr uint32_t WORDS = SLOTS / 64;
+
+    /**
+     * the first tick after `now_` expiring a slot of level 0 or starting
+     * the span of an occupied slot of a higher level, which is cascaded
+     * then. a slot of level n hold the timers of one span of SLOTS^n
+     * ticks, at most SLOTS spans ahead.
+     */
+    uint64_t next_tick() const {
+        uint64_t next = UINT64_MAX;
+        for (uint32_t level = 0; level < LEVELS; level++) {
+            uint32_t shift = SLOT_BITS * level;
+            uint64_t span = (now_ >> shift) + 1;
+            uint32_t ahead = this->next_slot(level, span & (SLOTS - 1));
+            if (ahead < SLOTS) {
+                next = std::min(next, (span + ahead) << shift);
+            }
+        }
+        return next;
+    }
+
+    /* slots from `from` to the next occupied slot of `level`, SLOTS if none */
+    uint32_t next_slot(uint32_t level, uint32_t from) const {
+        uint32_t word = from / 64;
+        uint64_t bits = occupied_[level][word] & (~0UL << (from % 64));
+        for (uint32_t i = 0;; i++) {
+            if (bits) {
+                uint32_t slot =
+                    ((word + i) % WORDS) * 64 + __builtin_ctzl(bits);
+                return (slot - from) & (SLOTS - 1);
+            }
+            if (i == WORDS) {
+                return SLOTS;
+            }
+            // the last round wrap to the bits of the first word before `from`
+            bits = occupied_[level][(word + i + 1) % WORDS];
+        }
+    }
+
+    void link(Timer* timer) {
+        uint64_t delay = timer->expires_ - now_;
+        uint32_t level = 0;
+        while (level + 1 < LEVELS && delay >= (1UL << (SLOT_BITS * (level + 1)))) {
+            level++;
+        }
+        uint32_t index = (timer->expires_ >> (SLOT_BITS * level)) & (SLOTS - 1);
+        auto& slot = slots_[level][index];
+        timer->next_ = slot;
+        timer->pprev_ = &slot;
+        if (slot) {
+            slot->pprev_ = &timer->next_;
+        }
+        slot = timer;
+        occupied_[level][index / 64] |= 1UL << (index % 64);
+    }
+
+    void unlink(Timer* timer) {
+        *timer->pprev_ = timer->next_;
+        if (timer->next_) {
+            timer->next_->pprev_ = timer->pprev_;
+        } else if (this->is_slot(timer->pprev_)) {
+            this->clear_slot(timer->pprev_ - &slots_[0][0]);
+        }
+        timer->next_ = nullptr;
+        timer->pprev_ = nullptr;
+    }
+
+    bool is_slot(Timer** link) const {
+        return link >= &slots_[0][0] && link < &slots_[0][0] + LEVELS * SLOTS;
+    }
+
+    /* `index` of the flattened `slots_` */
+    void clear_slot(size_t index) {
+        uint32_t slot = index % SLOTS;
+        occupied_[index / SLOTS][slot / 64] &= ~(1UL << (slot % 64));
+    }
+
+    /**
+     * spread the slot of `level` now due over the finer levels, the list is
+     * detached first as a clamped timer may land in the same slot again.
+     */
+    void cascade(uint32_t level) {
+        uint32_t index = (now_ >> (SLOT_BITS * level)) & (SLOTS - 1);
+        Timer* timer = std::exchange(slots_[level][index], nullptr);
+        this->clear_slot(level * SLOTS + index);
+        while (timer) {
+            Timer* next = timer->next_;
+            this->link(timer);
+            timer = next;
+        }
+    }
+
+    uint64_t now_; /**< last tick expired */
+    uint32_t size_ {};
+    Timer* slots_[LEVELS][SLOTS] {};
+    uint64_t occupied_[LEVELS][WORDS] {}; /**< non-empty slots */
+};
+
+} // namespace sqk
+
+#endif // !SQK_CORE_TIMER_HPP
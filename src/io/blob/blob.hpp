@@ -1,8 +1,19 @@
 #ifndef SQK_IO_BLOB_BLOB_HPP_
 #define SQK_IO_BLOB_BLOB_HPP_
 
+#include <sched.h>
+#include <sys/uio.h>
+
+#include <cctype>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <vector>
+
 #include "core.hpp"
+#include "dma_pool.hpp"
 #include "spdk/bdev.h"
+#include "spdk/cpuset.h"
 #include "spdk/blob.h"
 #include "spdk/blob_bdev.h"
 #include "spdk/env.h"
@@ -21,15 +32,335 @@ struct BlobOptions: spdk_env_opts {
     BlobOptions() {
         spdk_env_opts_init(this);
     }
+
+    /**
+     * cpus of `core_mask`, either a hex mask ("0xf") or a list ("[0,2-3]")
+     * as SPDK take it, to pin the workers of a `SQKSchedulerGroup` on.
+     */
+    std::vector<int> cpus() const {
+        std::vector<int> cpus;
+        std::string_view mask = core_mask ? core_mask : "0x1";
+        if (mask.starts_with('[')) {
+            std::string list(mask.substr(1, mask.find(']') - 1));
+            for (char* pos = list.data(); *pos;) {
+                int first = strtol(pos, &pos, 10);
+                int last = *pos == '-' ? strtol(pos + 1, &pos, 10) : first;
+                for (int cpu = first; cpu <= last; cpu++) {
+                    cpus.push_back(cpu);
+                }
+                pos += *pos == ',';
+            }
+            return cpus;
+        }
+        if (mask.starts_with("0x") || mask.starts_with("0X")) {
+            mask.remove_prefix(2);
+        }
+        // lowest cpus are at the end of the string
+        for (size_t i = 0; i < mask.size(); i++) {
+            char c = std::tolower(mask[mask.size() - 1 - i]);
+            int nibble = c <= '9' ? c - '0' : c - 'a' + 10;
+            for (int bit = 0; bit < 4; bit++) {
+                if (nibble & (1 << bit)) {
+                    cpus.push_back(i * 4 + bit);
+                }
+            }
+        }
+        return cpus;
+    }
 };
 
+struct BlobEventLoop;
+
 inline void common_cb(void* cb_arg, int bserrno) {
     auto awaker = static_cast<Awaker<int>*>(cb_arg);
     awaker->wake(std::move(bserrno));
 }
 
+/**
+ * a blob read or write, awaiting it issue the IO from `await_suspend` and
+ * the completion resume the awaiting coroutine right from the SPDK
+ * poller, no coroutine frame is allocated and no scheduler round trip is
+ * taken. the awaiter must be awaited on the thread owning `channel_`.
+ *
+ * vectored ops scatter/gather through `iov_`, which must stay valid until
+ * completion. submitting kick `loop_`, the poller of the channel's SPDK
+ * thread, which may be skipped as idle otherwise.
+ */
+struct BlobIoAwaiter {
+    enum class Op : uint8_t {
+        READ,
+        WRITE,
+        READV,
+        WRITEV,
+    };
+
+    spdk_blob* blob_;
+    spdk_io_channel* channel_;
+    BlobEventLoop* loop_ {nullptr};
+    uint8_t* buf_ {nullptr};
+    iovec* iov_ {nullptr};
+    int iovcnt_ {0};
+    uint64_t offset_;
+    uint64_t length_;
+    Op op_;
+    bool submitting_ {false};
+    bool done_ {false};
+    int rc_ {0};
+    std::coroutine_handle<> handle_ {nullptr};
+
+    constexpr bool await_ready() const noexcept {
+        return false;
+    }
+
+    /* a submit error may complete inline, don't suspend then */
+    bool await_suspend(std::coroutine_handle<> handle) noexcept {
+        handle_ = handle;
+        submitting_ = true;
+        this->submit(complete, this);
+        submitting_ = false;
+        return !done_;
+    }
+
+    int await_resume() const noexcept {
+        return rc_;
+    }
+
+    /* issue the IO, `cb` is called with `cb_arg` once it completed */
+    void submit(spdk_blob_op_complete cb, void* cb_arg) noexcept {
+        switch (op_) {
+            case Op::READ:
+                spdk_blob_io_read(
+                    blob_,
+                    channel_,
+                    buf_,
+                    offset_,
+                    length_,
+                    cb,
+                    cb_arg
+                );
+                break;
+            case Op::WRITE:
+                spdk_blob_io_write(
+                    blob_,
+                    channel_,
+                    buf_,
+                    offset_,
+                    length_,
+                    cb,
+                    cb_arg
+                );
+                break;
+            case Op::READV:
+                spdk_blob_io_readv(
+                    blob_,
+                    channel_,
+                    iov_,
+                    iovcnt_,
+                    offset_,
+                    length_,
+                    cb,
+                    cb_arg
+                );
+                break;
+            case Op::WRITEV:
+                spdk_blob_io_writev(
+                    blob_,
+                    channel_,
+                    iov_,
+                    iovcnt_,
+                    offset_,
+                    length_,
+                    cb,
+                    cb_arg
+                );
+                break;
+        }
+        if (loop_) {
+            scheduler->kick_poller(loop_);
+        }
+    }
+
+  private:
+    static void complete(void* cb_arg, int bserrno) {
+        auto io = static_cast<BlobIoAwaiter*>(cb_arg);
+        io->rc_ = bserrno;
+        if (io->submitting_) {
+            io->done_ = true;
+            return;
+        }
+        io->handle_.resume();
+    }
+};
+
+/**
+ * up to `N` blob IOs submitted together and awaited with one suspension,
+ * `co_await batch.wait()` resume once all of them completed and
+ * `co_await batch.wait(k)` once the first `k` did, both return the first
+ * error seen or 0.
+ *
+ * IOs are issued on the first wait, IOs still in flight after a partial
+ * wait keep referring to the batch: await `wait()` again before it goes
+ * out of scope.
+ */
+template<uint32_t N>
+struct BlobIoBatch {
+    struct WaitAwaiter {
+        BlobIoBatch& batch_;
+        uint32_t target_;
+
+        bool await_ready() noexcept {
+            batch_.submit();
+            return batch_.completed_ >= target_;
+        }
+
+        void await_suspend(std::coroutine_handle<> handle) noexcept {
+            batch_.target_ = target_;
+            batch_.handle_ = handle;
+        }
+
+        int await_resume() const noexcept {
+            return batch_.rc_;
+        }
+    };
+
+    BlobIoBatch() = default;
+    BlobIoBatch(BlobIoBatch&) = delete;
+    BlobIoBatch& operator=(BlobIoBatch&) = delete;
+
+    ~BlobIoBatch() {
+        S_ASSERT(completed_ == submitted_);
+    }
+
+    /* queue an IO made by `Blob::read` and friends */
+    void add(BlobIoAwaiter io) noexcept {
+        S_ASSERT(count_ < N && submitted_ == 0);
+        entries_[count_++] = {io, this};
+    }
+
+    WaitAwaiter wait(uint32_t k = N) noexcept {
+        return {*this, std::min(k, count_)};
+    }
+
+    uint32_t size() const noexcept {
+        return count_;
+    }
+
+    uint32_t completed() const noexcept {
+        return completed_;
+    }
+
+    /* result of the `i`th IO added, valid once it completed */
+    int rc(uint32_t i) const noexcept {
+        return entries_[i].io_.rc_;
+    }
+
+  private:
+    struct Entry {
+        BlobIoAwaiter io_;
+        BlobIoBatch* batch_;
+    };
+
+    void submit() noexcept {
+        while (submitted_ < count_) {
+            auto& entry = entries_[submitted_++];
+            entry.io_.submit(complete, &entry);
+        }
+    }
+
+    static void complete(void* cb_arg, int bserrno) {
+        auto entry = static_cast<Entry*>(cb_arg);
+        auto batch = entry->batch_;
+        entry->io_.rc_ = bserrno;
+        if (bserrno && batch->rc_ == 0) {
+            batch->rc_ = bserrno;
+        }
+        if (++batch->completed_ >= batch->target_ && batch->handle_) {
+            auto handle = batch->handle_;
+            batch->handle_ = nullptr;
+            handle.resume();
+        }
+    }
+
+    Entry entries_[N];
+    uint32_t count_ {0};
+    uint32_t submitted_ {0};
+    uint32_t completed_ {0};
+    uint32_t target_ {0};
+    int rc_ {0};
+    std::coroutine_handle<> handle_ {nullptr};
+};
+
+/**
+ * io channels of a blob store, one per scheduler, allocated by the first
+ * IO a worker issue and reused by every blob of the store. a channel is
+ * bound to the spdk thread of the worker that allocated it, so slots are
+ * only ever touched by their own worker.
+ *
+ * metadata ops are issued from `md_worker`, the worker which initialized
+ * the store and whose spdk thread is its metadata thread.
+ */
+struct BlobChannels {
+    static constexpr uint32_t MAX_WORKERS = 256;
+
+    BlobChannels(spdk_blob_store* bs, SQKScheduler* md_worker) :
+        bs_(bs),
+        md_worker_(md_worker) {}
+
+    BlobChannels(BlobChannels&) = delete;
+    BlobChannels& operator=(BlobChannels&) = delete;
+
+    /* channel of the current scheduler, allocate it on first use */
+    spdk_io_channel* get() {
+        auto& channel = channels_[this->slot()];
+        if (unlikely(channel == nullptr)) {
+            channel = spdk_bs_alloc_io_channel(bs_);
+            if (unlikely(channel == nullptr)) {
+                throw std::bad_alloc {};
+            }
+        }
+        return channel;
+    }
+
+    /* free the channel of the current scheduler, if it has one */
+    void put() {
+        auto& channel = channels_[this->slot()];
+        if (channel) {
+            spdk_bs_free_io_channel(channel);
+            channel = nullptr;
+        }
+        loops_[this->slot()] = nullptr;
+    }
+
+    /* the event loop polled by the current scheduler, null until polled */
+    inline BlobEventLoop* loop();
+
+    SQKScheduler& md_worker() const {
+        return *md_worker_;
+    }
+
+    size_t io_unit_size() const {
+        return spdk_bs_get_io_unit_size(bs_);
+    }
+
+  private:
+    uint32_t slot() const {
+        S_ASSERT(scheduler && scheduler->id() < MAX_WORKERS);
+        return scheduler->id();
+    }
+
+    spdk_blob_store* bs_;
+    SQKScheduler* md_worker_;
+    spdk_io_channel* channels_[MAX_WORKERS] {};
+    BlobEventLoop* loops_[MAX_WORKERS] {};
+};
+
+/**
+ * IOs go through the channel of the scheduler creating the awaiter, a
+ * blob can be shared by every worker as long as each await its own IOs.
+ */
 struct Blob {
     Task<int> resize(size_t size) {
+        co_await resume_on(channels_->md_worker());
         Awaker<int> awaker;
         spdk_blob_resize(blob_, size, common_cb, &awaker);
         int rc = co_await awaker;
@@ -41,40 +372,89 @@ struct Blob {
     }
 
     Task<int> sync_meta_data() {
+        co_await resume_on(channels_->md_worker());
         Awaker<int> awaker;
         spdk_blob_sync_md(blob_, common_cb, &awaker);
         int rc = co_await awaker;
         co_return rc;
     }
 
-    Task<int> write(uint8_t* buf, size_t offset, size_t length) {
+    /* close the blob, no IO of it may be in flight */
+    Task<int> close() {
+        co_await resume_on(channels_->md_worker());
         Awaker<int> awaker;
-        spdk_blob_io_write(
-            blob_,
-            channel_,
-            buf,
-            offset,
-            length,
-            common_cb,
-            &awaker
-        );
+        spdk_blob_close(blob_, common_cb, &awaker);
         int rc = co_await awaker;
         co_return rc;
     }
 
-    Task<int> read(uint8_t* buf, size_t offset, size_t length) {
-        Awaker<int> awaker;
-        spdk_blob_io_read(
-            blob_,
-            channel_,
-            buf,
-            offset,
-            length,
-            common_cb,
-            &awaker
-        );
-        int rc = co_await awaker;
-        co_return rc;
+    BlobIoAwaiter write(uint8_t* buf, size_t offset, size_t length) {
+        return {
+            .blob_ = blob_,
+            .channel_ = channels_->get(),
+            .loop_ = channels_->loop(),
+            .buf_ = buf,
+            .offset_ = offset,
+            .length_ = length,
+            .op_ = BlobIoAwaiter::Op::WRITE,
+        };
+    }
+
+    BlobIoAwaiter read(uint8_t* buf, size_t offset, size_t length) {
+        return {
+            .blob_ = blob_,
+            .channel_ = channels_->get(),
+            .loop_ = channels_->loop(),
+            .buf_ = buf,
+            .offset_ = offset,
+            .length_ = length,
+            .op_ = BlobIoAwaiter::Op::READ,
+        };
+    }
+
+    /* `buf` must hold `length` io units and outlive the IO */
+    BlobIoAwaiter write(const DmaBuf& buf, size_t offset, size_t length) {
+        S_ASSERT(length * channels_->io_unit_size() <= buf.size());
+        return this->write(buf.data(), offset, length);
+    }
+
+    BlobIoAwaiter read(const DmaBuf& buf, size_t offset, size_t length) {
+        S_ASSERT(length * channels_->io_unit_size() <= buf.size());
+        return this->read(buf.data(), offset, length);
+    }
+
+    // a temporary buffer would be freed before the IO complete
+    BlobIoAwaiter write(DmaBuf&& buf, size_t offset, size_t length) = delete;
+    BlobIoAwaiter read(DmaBuf&& buf, size_t offset, size_t length) = delete;
+
+    /* gather `iovcnt` segments into `length` io units at `offset` */
+    BlobIoAwaiter
+    writev(iovec* iov, int iovcnt, size_t offset, size_t length) {
+        return {
+            .blob_ = blob_,
+            .channel_ = channels_->get(),
+            .loop_ = channels_->loop(),
+            .iov_ = iov,
+            .iovcnt_ = iovcnt,
+            .offset_ = offset,
+            .length_ = length,
+            .op_ = BlobIoAwaiter::Op::WRITEV,
+        };
+    }
+
+    /* scatter `length` io units at `offset` into `iovcnt` segments */
+    BlobIoAwaiter
+    readv(iovec* iov, int iovcnt, size_t offset, size_t length) {
+        return {
+            .blob_ = blob_,
+            .channel_ = channels_->get(),
+            .loop_ = channels_->loop(),
+            .iov_ = iov,
+            .iovcnt_ = iovcnt,
+            .offset_ = offset,
+            .length_ = length,
+            .op_ = BlobIoAwaiter::Op::READV,
+        };
     }
 
     Blob() {}
@@ -82,11 +462,11 @@ struct Blob {
   private:
     friend class BlobStore;
 
-    Blob(spdk_blob* blob, spdk_io_channel* channel) :
-        blob_(blob),
-        channel_(channel) {}
+    Blob(spdk_blob* blob, std::shared_ptr<BlobChannels> channels) :
+        channels_(std::move(channels)),
+        blob_(blob) {}
 
-    spdk_io_channel* channel_;
+    std::shared_ptr<BlobChannels> channels_;
     spdk_blob* blob_;
 };
 
@@ -99,7 +479,12 @@ struct BlobStore {
         return spdk_bs_get_io_unit_size(bs_);
     }
 
+    size_t get_cluster_size() {
+        return spdk_bs_get_cluster_size(bs_);
+    }
+
     Task<Blob> make_blob() {
+        co_await resume_on(channels_->md_worker());
         Awaker<spdk_blob_id> awaker;
         spdk_bs_create_blob(
             bs_,
@@ -111,6 +496,7 @@ struct BlobStore {
             &awaker
         );
         auto blob_id = co_await awaker;
+        co_await resume_on(channels_->md_worker());
         Awaker<spdk_blob*> blob_awaker;
         spdk_bs_open_blob(
             bs_,
@@ -123,8 +509,36 @@ struct BlobStore {
             &blob_awaker
         );
         auto blob = co_await blob_awaker;
-        spdk_io_channel* channel = spdk_bs_alloc_io_channel(bs_);
-        co_return Blob(blob, channel);
+        co_return Blob(blob, channels_);
+    }
+
+    /**
+     * free the io channel of the calling worker, every worker that issued
+     * IO must call it before the store is unloaded.
+     */
+    void release_channel() {
+        channels_->put();
+    }
+
+    /* release the channels of every worker of `group` */
+    Task<void> release_channels(SQKSchedulerGroup& group) {
+        for (uint32_t id = 0; id < group.size(); id++) {
+            co_await resume_on(group.worker(id));
+            channels_->put();
+        }
+    }
+
+    /**
+     * unload the store from its metadata worker, which hold the metadata
+     * channel until then. its blobs must be closed and every worker must
+     * have released its channel.
+     */
+    Task<int> unload() {
+        co_await resume_on(channels_->md_worker());
+        Awaker<int> awaker;
+        spdk_bs_unload(bs_, common_cb, &awaker);
+        int rc = co_await awaker;
+        co_return rc;
     }
 
     BlobStore() {}
@@ -132,15 +546,20 @@ struct BlobStore {
   private:
     friend struct BlobDev;
 
-    BlobStore(spdk_blob_store* bs) : bs_(bs) {}
+    BlobStore(spdk_blob_store* bs, SQKScheduler* md_worker) :
+        bs_(bs),
+        channels_(std::make_shared<BlobChannels>(bs, md_worker)) {}
 
     spdk_blob_store* bs_;
+    std::shared_ptr<BlobChannels> channels_;
 };
 
 struct BlobDev {
     BlobDev(spdk_bs_dev* bs_dev) : bs_dev_(bs_dev) {}
 
+    /* the calling worker become the metadata worker of the store */
     Task<BlobStore> init_blobstore() {
+        auto md_worker = scheduler;
         Awaker<spdk_blob_store*> awaker;
         spdk_bs_init(
             bs_dev_,
@@ -153,7 +572,7 @@ struct BlobDev {
             &awaker
         );
         auto bs = co_await awaker;
-        co_return BlobStore(bs);
+        co_return BlobStore(bs, md_worker);
     }
 
   private:
@@ -161,9 +580,20 @@ struct BlobDev {
     spdk_bs_dev* bs_dev_;
 };
 
+/**
+ * the SPDK thread of a BlobEnv, register it with `SQKScheduler::add_poller`
+ * so the worker poll it between tasks instead of a spinning coroutine.
+ */
 struct BlobEventLoop {
-    void poll() {
-        spdk_thread_poll(thread_, 0, 0);
+    /* > 0 when any SPDK poller or message did work */
+    int poll() {
+        local_ = this;
+        return spdk_thread_poll(thread_, 0, 0);
+    }
+
+    /* the loop the calling worker polled last, if any */
+    static BlobEventLoop* local() {
+        return local_;
     }
 
   private:
@@ -171,9 +601,32 @@ struct BlobEventLoop {
 
     BlobEventLoop(spdk_thread* thread) : thread_(thread) {}
 
+    /* exit and destroy the thread, its io channels must be released */
+    void exit() {
+        if (local_ == this) {
+            local_ = nullptr;
+        }
+        spdk_thread_exit(thread_);
+        while (!spdk_thread_is_exited(thread_)) {
+            spdk_thread_poll(thread_, 0, 0);
+        }
+        spdk_thread_destroy(thread_);
+        spdk_set_thread(nullptr);
+    }
+
+    static inline thread_local BlobEventLoop* local_ {};
+
     spdk_thread* thread_;
 };
 
+inline BlobEventLoop* BlobChannels::loop() {
+    auto& loop = loops_[this->slot()];
+    if (unlikely(loop == nullptr)) {
+        loop = BlobEventLoop::local();
+    }
+    return loop;
+}
+
 struct BlobEnv: enable_shared_from_this<BlobEnv> {
     Task<int> setup(BlobOptions& opt) {
         int rc;
@@ -266,6 +719,48 @@ struct BlobEnv: enable_shared_from_this<BlobEnv> {
         return BlobEventLoop(thread);
     }
 
+    /**
+     * give every worker of `group` an SPDK thread of its own, bound to the
+     * cpu the worker is pinned on and polled by it, so the IOs a worker
+     * submit are completed and resumed on that worker and blob throughput
+     * scale with the workers. pin the group on `BlobOptions::cpus`.
+     *
+     * the worker initializing the blobstore own its metadata thread,
+     * metadata ops (create, open, resize, sync) hop to that worker.
+     */
+    Task<void> start_reactors(SQKSchedulerGroup& group) {
+        S_ASSERT(reactors_.empty());
+        // pollers keep a pointer to their reactor
+        reactors_.reserve(group.size());
+        for (uint32_t id = 0; id < group.size(); id++) {
+            co_await resume_on(group.worker(id));
+            spdk_cpuset cpumask;
+            spdk_cpuset_zero(&cpumask);
+            spdk_cpuset_set_cpu(&cpumask, sched_getcpu(), true);
+            auto name = fmt::format("reactor_{}", id);
+            spdk_thread* thread = spdk_thread_create(name.c_str(), &cpumask);
+            if (!thread) {
+                throw std::bad_alloc {};
+            }
+            spdk_set_thread(thread);
+            reactors_.push_back(BlobEventLoop(thread));
+            scheduler->add_poller(reactors_.back());
+        }
+    }
+
+    /**
+     * exit the reactors of `group` once the blobstores are unloaded, the
+     * metadata reactor would otherwise spin until SPDK force it to exit.
+     */
+    Task<void> stop_reactors(SQKSchedulerGroup& group) {
+        for (uint32_t id = 0; id < reactors_.size(); id++) {
+            co_await resume_on(group.worker(id));
+            scheduler->remove_poller(&reactors_[id]);
+            reactors_[id].exit();
+        }
+        reactors_.clear();
+    }
+
     BlobDev make_blob_dev(std::string dev_name) {
         spdk_bs_dev* bs_dev;
         int rc = spdk_bdev_create_bs_dev_ext(
@@ -281,8 +776,12 @@ struct BlobEnv: enable_shared_from_this<BlobEnv> {
         }
         return BlobDev(bs_dev);
     }
+
+  private:
+    std::vector<BlobEventLoop> reactors_; /**< one per worker */
 };
 
+/* a one-off DMA buffer, prefer `DmaPool::get` on the IO path */
 inline uint8_t* dma_alloc(
     size_t size,
     size_t align,
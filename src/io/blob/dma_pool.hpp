@@ -0,0 +1,201 @@
+#ifndef SQK_IO_BLOB_DMA_POOL_HPP_
+#define SQK_IO_BLOB_DMA_POOL_HPP_
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+#include "spdk/env.h"
+#include "utilty.h"
+
+namespace sqk::io::blob {
+
+struct DmaPool;
+
+/**
+ * a DMA-safe buffer of a `DmaPool` size class, returned to the pool of the
+ * releasing thread when the handle is destroyed. `size` is the capacity of
+ * the class, at least the size asked for.
+ */
+struct DmaBuf {
+    DmaBuf() noexcept {}
+
+    DmaBuf(DmaBuf&& other) noexcept :
+        buf_(std::exchange(other.buf_, nullptr)),
+        size_(other.size_),
+        socket_(other.socket_) {}
+
+    DmaBuf& operator=(DmaBuf&& other) noexcept {
+        if (this != &other) {
+            this->reset();
+            buf_ = std::exchange(other.buf_, nullptr);
+            size_ = other.size_;
+            socket_ = other.socket_;
+        }
+        return *this;
+    }
+
+    DmaBuf(DmaBuf&) = delete;
+    DmaBuf& operator=(DmaBuf&) = delete;
+
+    ~DmaBuf() {
+        this->reset();
+    }
+
+    uint8_t* data() const noexcept {
+        return buf_;
+    }
+
+    std::size_t size() const noexcept {
+        return size_;
+    }
+
+    explicit operator bool() const noexcept {
+        return buf_ != nullptr;
+    }
+
+    inline void reset() noexcept;
+
+  private:
+    friend struct DmaPool;
+
+    DmaBuf(uint8_t* buf, std::size_t size, int socket) noexcept :
+        buf_(buf),
+        size_(size),
+        socket_(socket) {}
+
+    uint8_t* buf_ {nullptr};
+    std::size_t size_ {0};
+    int socket_ {SPDK_ENV_SOCKET_ID_ANY};
+};
+
+/**
+ * per-thread cache of DMA buffers in power-of-two size classes from
+ * MIN_SIZE to MAX_SIZE, aligned to MIN_SIZE so any io unit fit. a buffer
+ * is recycled by whichever thread release it, up to `cache_limit` bytes
+ * per class and socket, beyond that and above MAX_SIZE it go back to
+ * `spdk_free`. after warm up the IO path never reach the DPDK allocator.
+ *
+ * buffers are kept apart per NUMA socket, `SPDK_ENV_SOCKET_ID_ANY` being
+ * a socket of its own.
+ */
+struct DmaPool {
+    static constexpr uint32_t MIN_SHIFT = 12;
+    static constexpr uint32_t MAX_SHIFT = 20;
+    static constexpr std::size_t MIN_SIZE = 1UL << MIN_SHIFT;
+    static constexpr std::size_t MAX_SIZE = 1UL << MAX_SHIFT;
+    static constexpr uint32_t CLASSES = MAX_SHIFT - MIN_SHIFT + 1;
+    static constexpr int MAX_SOCKETS = 8;
+
+    DmaPool() noexcept {}
+
+    DmaPool(DmaPool&) = delete;
+    DmaPool& operator=(DmaPool&) = delete;
+
+    ~DmaPool() {
+        for (auto& socket : free_) {
+            for (auto& bin : socket) {
+                while (bin.head_) {
+                    auto node = bin.head_;
+                    bin.head_ = node->next_;
+                    spdk_free(node);
+                }
+            }
+        }
+    }
+
+    /**
+     * a buffer of at least `size` bytes, placed on `socket`. the handle is
+     * empty if the DMA memory is exhausted.
+     */
+    static DmaBuf get(std::size_t size, int socket = SPDK_ENV_SOCKET_ID_ANY) {
+        return local().take(size, socket);
+    }
+
+    /* max bytes cached per size class and socket by each thread */
+    static void set_cache_limit(std::size_t bytes) noexcept {
+        cache_limit_.store(bytes, std::memory_order_relaxed);
+    }
+
+    static DmaPool& local() noexcept {
+        static thread_local DmaPool pool;
+        return pool;
+    }
+
+  private:
+    friend struct DmaBuf;
+
+    struct FreeNode {
+        FreeNode* next_;
+    };
+
+    struct Bin {
+        FreeNode* head_ {nullptr};
+        std::size_t cached_ {0}; /**< bytes in the list */
+    };
+
+    static std::size_t class_size(std::size_t size) noexcept {
+        return std::max(std::bit_ceil(size), MIN_SIZE);
+    }
+
+    static uint32_t class_of(std::size_t size) noexcept {
+        return std::countr_zero(size) - MIN_SHIFT;
+    }
+
+    Bin* bin(std::size_t size, int socket) noexcept {
+        if (size > MAX_SIZE || socket < SPDK_ENV_SOCKET_ID_ANY
+            || socket >= MAX_SOCKETS - 1) {
+            return nullptr;
+        }
+        return &free_[socket + 1][class_of(size)];
+    }
+
+    DmaBuf take(std::size_t size, int socket) {
+        size = class_size(size);
+        Bin* bin = this->bin(size, socket);
+        if (likely(bin && bin->head_)) {
+            auto node = bin->head_;
+            bin->head_ = node->next_;
+            bin->cached_ -= size;
+            return DmaBuf(reinterpret_cast<uint8_t*>(node), size, socket);
+        }
+        auto buf = static_cast<uint8_t*>(
+            spdk_malloc(size, MIN_SIZE, nullptr, socket, SPDK_MALLOC_DMA)
+        );
+        if (unlikely(buf == nullptr)) {
+            return {};
+        }
+        return DmaBuf(buf, size, socket);
+    }
+
+    void give(uint8_t* buf, std::size_t size, int socket) noexcept {
+        Bin* bin = this->bin(size, socket);
+        auto limit = cache_limit_.load(std::memory_order_relaxed);
+        if (unlikely(bin == nullptr || bin->cached_ + size > limit)) {
+            spdk_free(buf);
+            return;
+        }
+        auto node = reinterpret_cast<FreeNode*>(buf);
+        node->next_ = bin->head_;
+        bin->head_ = node;
+        bin->cached_ += size;
+    }
+
+    static inline std::atomic<std::size_t> cache_limit_ {4UL << 20};
+
+    Bin free_[MAX_SOCKETS][CLASSES];
+};
+
+inline void DmaBuf::reset() noexcept {
+    if (buf_) {
+        DmaPool::local().give(buf_, size_, socket_);
+        buf_ = nullptr;
+    }
+}
+
+} // namespace sqk::io::blob
+
+#endif // !SQK_IO_BLOB_DMA_POOL_HPP_
@@ -0,0 +1,145 @@
+#ifndef SQK_IO_FILE_FILE_HPP_
+#define SQK_IO_FILE_FILE_HPP_
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <system_error>
+#include <utility>
+
+#include "uring.hpp"
+
+namespace sqk::io {
+using net::uring::Uring;
+using net::uring::UringOp;
+
+/**
+ * a file read and written through the io_uring of the calling worker,
+ * `co_await file.read(buf, len, off)` return the bytes transferred or a
+ * negative errno, like `pread`, without blocking the worker nor handing
+ * the IO to a thread pool.
+ *
+ * opened with O_DIRECT, buffers, lengths and offsets must be aligned to
+ * the logical block size of the device, 4KB alignment always fit.
+ * `register_fixed` put the fd into the fixed file table of the calling
+ * worker's ring, and `read_fixed`/`write_fixed` go through buffers
+ * registered by `Uring::register_buffers`, both only apply to that ring.
+ * a registered file must be destroyed on the worker which registered it.
+ */
+struct File {
+    /* open `path`, throw `std::system_error` on failure */
+    static File open(const char* path, int flags, mode_t mode = 0644) {
+        int fd = ::open(path, flags | O_CLOEXEC, mode);
+        if (fd < 0) {
+            throw std::system_error(errno, std::system_category());
+        }
+        return File(fd);
+    }
+
+    explicit File(int fd) : fd_(fd) {}
+
+    File(File&& other) :
+        fd_(std::exchange(other.fd_, -1)),
+        fixed_ring_(std::exchange(other.fixed_ring_, nullptr)),
+        fixed_index_(other.fixed_index_) {}
+
+    File(File&) = delete;
+    File& operator=(File&) = delete;
+
+    ~File() {
+        if (fixed_ring_) {
+            fixed_ring_->unregister_file(fixed_index_);
+        }
+        if (fd_ >= 0) {
+            ::close(fd_);
+        }
+    }
+
+    int fd() const {
+        return fd_;
+    }
+
+    /**
+     * register the fd with the calling worker's ring, ops issued from that
+     * worker then skip the per-op file lookup. return a negative errno on
+     * failure, the file keep working unregistered.
+     */
+    int register_fixed() {
+        S_ASSERT(fixed_ring_ == nullptr);
+        auto& ring = Uring::local();
+        int index = ring.register_file(fd_);
+        if (index < 0) {
+            return index;
+        }
+        fixed_ring_ = &ring;
+        fixed_index_ = index;
+        return 0;
+    }
+
+    UringOp read(void* buf, uint32_t len, uint64_t offset) {
+        auto& ring = Uring::local();
+        return this->target(ring.read(fd_, buf, len, offset));
+    }
+
+    UringOp write(const void* buf, uint32_t len, uint64_t offset) {
+        auto& ring = Uring::local();
+        return this->target(ring.write(fd_, buf, len, offset));
+    }
+
+    /* `buf` must lie in the registered buffer `buf_index` */
+    UringOp
+    read_fixed(void* buf, uint32_t len, uint64_t offset, uint16_t buf_index) {
+        auto op = this->read(buf, len, offset);
+        op.op_ = UringOp::Op::READ_FIXED;
+        op.buf_index_ = buf_index;
+        return op;
+    }
+
+    UringOp write_fixed(
+        const void* buf,
+        uint32_t len,
+        uint64_t offset,
+        uint16_t buf_index
+    ) {
+        auto op = this->write(buf, len, offset);
+        op.op_ = UringOp::Op::WRITE_FIXED;
+        op.buf_index_ = buf_index;
+        return op;
+    }
+
+    /* `datasync` skip the metadata not needed to read the data back */
+    UringOp fsync(bool datasync = false) {
+        UringOp op(Uring::local(), UringOp::Op::FSYNC);
+        op.fd_ = fd_;
+        op.flags_ = datasync ? IORING_FSYNC_DATASYNC : 0;
+        return this->target(op);
+    }
+
+    /* preallocate `len` bytes at `offset`, `mode` as for fallocate(2) */
+    UringOp fallocate(uint64_t offset, uint64_t len, int mode = 0) {
+        UringOp op(Uring::local(), UringOp::Op::FALLOCATE);
+        op.fd_ = fd_;
+        op.offset_ = offset;
+        op.len_ = len;
+        op.flags_ = mode;
+        return this->target(op);
+    }
+
+  private:
+    /* use the fixed file slot when the op goes to the ring holding it */
+    UringOp target(UringOp op) {
+        if (&op.ring_ == fixed_ring_) {
+            op.fd_ = fixed_index_;
+            op.fixed_file_ = true;
+        }
+        return op;
+    }
+
+    int fd_;
+    Uring* fixed_ring_ {nullptr};
+    int fixed_index_ {-1};
+};
+
+} // namespace sqk::io
+
+#endif // !SQK_IO_FILE_FILE_HPP_
@@ -349,6 +349,15 @@ namespace net {
 
             REDIRECT_INNER(fi_cq_msg_entry, ent_);
         };
+        /**
+         * what a posted op's context is woken with: 0 or the negative errno
+         * it failed with, and the source address of a receive.
+         */
+        struct OpCompletion {
+            int err_;
+            Address addr_;
+        };
+
         class PassiveEndpoint;
 
         class EventQueue {
@@ -396,6 +405,12 @@ namespace net {
             }
 
             int poll(Event& event, Flags flags);
+
+            /* drain one event without blocking, for `SQKScheduler::add_poller` */
+            int poll() {
+                Event event;
+                return this->poll(event, 0);
+            }
         };
 
         class Domain {
@@ -451,23 +466,34 @@ namespace net {
                 if (rc == -FI_EAVAIL) {
                     CompletionQueueErrEntry err_ent {};
                     rc = fi_cq_readerr(cq, &err_ent.ent_, 0);
-                    auto err_data = std::vector<char>(1024);
-                    fi_cq_strerror(
-                        cq,
-                        err_ent->prov_errno,
-                        err_ent->err_data,
-                        err_data.data(),
-                        1024
-                    );
-                    auto err_string =
-                        std::string_view(err_data.begin(), err_data.end());
-                    S_ERROR(
-                        "cq_poll error: {}, prov_errno: {}, prov_error: {}",
-                        err_ent->err,
-                        err_ent->prov_errno,
-                        err_string
-                    );
-                    memcpy(&ent, &err_ent, sizeof(ent));
+                    if (rc != 1) {
+                        S_WARN("fi_cq_readerr: rc={}", rc);
+                        return rc;
+                    }
+                    // an op aborted by `fi_cancel` is expected, and may
+                    // not carry the flags of its kind
+                    if (err_ent->err != FI_ECANCELED) {
+                        auto err_data = std::vector<char>(1024);
+                        fi_cq_strerror(
+                            cq,
+                            err_ent->prov_errno,
+                            err_ent->err_data,
+                            err_data.data(),
+                            1024
+                        );
+                        auto err_string =
+                            std::string_view(err_data.begin(), err_data.end());
+                        S_ERROR(
+                            "cq_poll error: {}, prov_errno: {}, prov_error: {}",
+                            err_ent->err,
+                            err_ent->prov_errno,
+                            err_string
+                        );
+                    }
+                    auto awaker =
+                        static_cast<Awaker<OpCompletion>*>(err_ent->op_context);
+                    awaker->wake({-err_ent->err, {}});
+                    return rc;
                 }
                 if (rc == 1 && ent->flags & FI_RECV) {
                     S_DBUG(
@@ -475,11 +501,13 @@ namespace net {
                         fmt::ptr(ent.addr_())
                     );
                     auto awaker =
-                        static_cast<Awaker<Address>*>(ent->op_context);
-                    awaker->wake(ent.addr());
-                } else if (rc == 1 && ent->flags & (FI_SEND | FI_WRITE)) {
-                    auto awaker = static_cast<Awaker<void>*>(ent->op_context);
-                    awaker->wake();
+                        static_cast<Awaker<OpCompletion>*>(ent->op_context);
+                    awaker->wake({0, ent.addr()});
+                } else if (rc == 1
+                           && ent->flags & (FI_SEND | FI_WRITE | FI_READ)) {
+                    auto awaker =
+                        static_cast<Awaker<OpCompletion>*>(ent->op_context);
+                    awaker->wake({0, {}});
                 } else if (rc == 1) {
                     S_ERROR("unexpected event={}", ent->flags);
                 } else {
@@ -626,6 +654,38 @@ namespace net {
             }
         };
 
+        /**
+         * the completion of an op posted with `waker_` as its context,
+         * cancelling it abort the op with `fi_cancel`, which then complete
+         * with FI_ECANCELED through the CQ error path, see
+         * `sqk::with_timeout`. resume with the source address of a receive,
+         * or throw `std::system_error` if the op failed or was cancelled.
+         */
+        struct EndpointOp {
+            Awaker<OpCompletion>& waker_;
+            fid_ep* ep_;
+
+            bool await_ready() const noexcept {
+                return false;
+            }
+
+            void await_suspend(std::coroutine_handle<> handle) {
+                waker_.await_suspend(handle);
+            }
+
+            Address await_resume() {
+                auto done = waker_.await_resume();
+                if (done.err_) {
+                    throw std::system_error(-done.err_, std::system_category());
+                }
+                return done.addr_;
+            }
+
+            void cancel() {
+                fi_cancel(&ep_->fid, &waker_);
+            }
+        };
+
         class Endpoint {
             fid_ep* ep_;
             EventQueue& eq_;
@@ -694,7 +754,7 @@ namespace net {
                 MemoryRegion& mr,
                 std::optional<Address> dst = std::nullopt
             ) {
-                sqk::Awaker<void> waker;
+                sqk::Awaker<OpCompletion> waker;
                 int rc;
                 for (;;) {
                     rc = fi_send(
@@ -712,15 +772,15 @@ namespace net {
                 if (rc) {
                     throw std::system_error(-rc, std::system_category());
                 }
-                co_await waker;
+                co_await EndpointOp {waker, ep_};
             }
 
             sqk::Task<Address>
             recv(MemoryBuffer& buf, size_t size, MemoryRegion& mr) {
-                sqk::Awaker<Address> waker;
+                sqk::Awaker<OpCompletion> waker;
                 S_DBUG("fi_recv: {}", fmt::ptr(&waker));
                 MAYBE_THROW(fi_recv, ep_, buf.buf_, size, mr.desc(), 0, &waker);
-                Address addr = co_await waker;
+                Address addr = co_await EndpointOp {waker, ep_};
                 co_return addr;
             }
 
@@ -732,7 +792,7 @@ namespace net {
                 uint64_t key,
                 Address dst
             ) {
-                sqk::Awaker<Address> waker;
+                sqk::Awaker<OpCompletion> waker;
                 MAYBE_THROW(
                     fi_write,
                     ep_,
@@ -744,7 +804,7 @@ namespace net {
                     key,
                     &waker
                 );
-                co_await waker;
+                co_await EndpointOp {waker, ep_};
             }
 
             sqk::Task<void> read(
@@ -755,7 +815,7 @@ namespace net {
                 uint64_t key,
                 Address src
             ) {
-                sqk::Awaker<void> waker;
+                sqk::Awaker<OpCompletion> waker;
                 fi_read(
                     ep_,
                     buf.buf_,
@@ -766,7 +826,7 @@ namespace net {
                     key,
                     &waker
                 );
-                co_await waker;
+                co_await EndpointOp {waker, ep_};
             }
 
             void close() {
@@ -1,3 +1,726 @@
+#ifndef SQK_NET_IO_URING_URING_HPP_
+#define SQK_NET_IO_URING_URING_HPP_
+
 #include <liburing.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <bit>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <optional>
+#include <span>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include "core.hpp"
+
+namespace sqk::net::uring {
+
+struct Uring;
+struct UringStream;
+struct BufRing;
+
+/**
+ * what the `user_data` of a SQE point to, `Uring::poll` call `complete_`
+ * with the result and flags of each of its CQEs.
+ */
+struct UringCompletion {
+    using CompleteFn = void (*)(UringCompletion*, int res, uint32_t flags);
+
+    CompleteFn complete_;
+};
+
+/* result and flags of a CQE */
+struct UringCqe {
+    int res_;
+    uint32_t flags_;
+
+    /* the op stay armed and will complete again */
+    bool more() const {
+        return flags_ & IORING_CQE_F_MORE;
+    }
+
+    /* id of the provided buffer the data landed in, see `BufRing` */
+    uint16_t buffer_id() const {
+        S_ASSERT(flags_ & IORING_CQE_F_BUFFER);
+        return flags_ >> IORING_CQE_BUFFER_SHIFT;
+    }
+};
+
+/**
+ * how a ring is set up. with `sqpoll_` a kernel thread poll the SQ, so
+ * submitting take no syscall while it is awake, it fall asleep after
+ * `sq_idle_ms_` without SQEs, and is pinned on `sq_cpu_` unless negative.
+ */
+struct UringParams {
+    uint32_t entries_ {256};
+    bool sqpoll_ {false};
+    uint32_t sq_idle_ms_ {1000};
+    int sq_cpu_ {-1};
+};
+
+/**
+ * a one-shot io_uring op, awaiting it queue its SQE, which `Uring::poll`
+ * submit together with every SQE queued in the same scheduler round. the
+ * CQE resume the awaiting coroutine right from the poller, no coroutine
+ * frame is allocated. the result is the CQE's, a negative errno on
+ * failure.
+ *
+ * the op must be awaited on the worker polling `ring_`, buffers and
+ * addresses must stay valid until it completes.
+ */
+struct UringOp: UringCompletion {
+    enum class Op : uint8_t {
+        READ,
+        WRITE,
+        RECV,
+        SEND,
+        ACCEPT,
+        CONNECT,
+        TIMEOUT,
+        READ_FIXED, /**< into a buffer registered with the ring */
+        WRITE_FIXED,
+        FSYNC,
+        FALLOCATE,
+        SEND_ZC, /**< zero copy, done once the buffer is released */
+        SENDMSG,
+        RECVMSG,
+    };
+
+    UringOp(Uring& ring, Op op) :
+        UringCompletion {complete},
+        ring_(ring),
+        op_(op) {}
+
+    Uring& ring_;
+    Op op_;
+    int fd_ {-1};
+    void* buf_ {nullptr};
+    uint64_t len_ {0}; /**< 32 bits but for fallocate */
+    uint64_t offset_ {0};
+    int flags_ {0}; /**< send/recv, accept, fsync or fallocate flags */
+    bool fixed_file_ {false}; /**< `fd_` index the ring's file table */
+    uint16_t buf_index_ {0}; /**< registered buffer of fixed IOs */
+    sockaddr* addr_ {nullptr};
+    socklen_t* addrlen_ {nullptr}; /**< value-result for accept */
+    socklen_t socklen_ {0}; /**< length of `addr_` for connect */
+    msghdr* msg_ {nullptr}; /**< of sendmsg and recvmsg */
+    __kernel_timespec ts_ {};
+    int res_ {0};
+    std::coroutine_handle<> handle_ {};
+
+    constexpr bool await_ready() const noexcept {
+        return false;
+    }
+
+    /* a full SQ which cannot be submitted complete inline with -EBUSY */
+    inline bool await_suspend(std::coroutine_handle<> handle);
+
+    int await_resume() const noexcept {
+        return res_;
+    }
+
+    /* abort the pending op, which then complete with -ECANCELED */
+    inline void cancel();
+
+    void prep(io_uring_sqe* sqe) {
+        switch (op_) {
+            case Op::READ:
+                io_uring_prep_read(sqe, fd_, buf_, len_, offset_);
+                break;
+            case Op::WRITE:
+                io_uring_prep_write(sqe, fd_, buf_, len_, offset_);
+                break;
+            case Op::RECV:
+                io_uring_prep_recv(sqe, fd_, buf_, len_, flags_);
+                break;
+            case Op::SEND:
+                io_uring_prep_send(sqe, fd_, buf_, len_, flags_);
+                break;
+            case Op::ACCEPT:
+                io_uring_prep_accept(sqe, fd_, addr_, addrlen_, flags_);
+                break;
+            case Op::CONNECT:
+                io_uring_prep_connect(sqe, fd_, addr_, socklen_);
+                break;
+            case Op::TIMEOUT:
+                io_uring_prep_timeout(sqe, &ts_, 0, 0);
+                break;
+            case Op::READ_FIXED:
+                io_uring_prep_read_fixed(
+                    sqe,
+                    fd_,
+                    buf_,
+                    len_,
+                    offset_,
+                    buf_index_
+                );
+                break;
+            case Op::WRITE_FIXED:
+                io_uring_prep_write_fixed(
+                    sqe,
+                    fd_,
+                    buf_,
+                    len_,
+                    offset_,
+                    buf_index_
+                );
+                break;
+            case Op::FSYNC:
+                io_uring_prep_fsync(sqe, fd_, flags_);
+                break;
+            case Op::FALLOCATE:
+                io_uring_prep_fallocate(sqe, fd_, flags_, offset_, len_);
+                break;
+            case Op::SEND_ZC:
+                io_uring_prep_send_zc(sqe, fd_, buf_, len_, flags_, 0);
+                break;
+            case Op::SENDMSG:
+                io_uring_prep_sendmsg(sqe, fd_, msg_, flags_);
+                break;
+            case Op::RECVMSG:
+                io_uring_prep_recvmsg(sqe, fd_, msg_, flags_);
+                break;
+        }
+        if (fixed_file_) {
+            sqe->flags |= IOSQE_FIXED_FILE;
+        }
+    }
+
+  private:
+    static void complete(UringCompletion* completion, int res, uint32_t flags) {
+        auto op = static_cast<UringOp*>(completion);
+        if (unlikely(flags & IORING_CQE_F_NOTIF)) {
+            op->handle_.resume();
+            return;
+        }
+        op->res_ = res;
+        // a zero copy send still hold the buffer, wait for its notification
+        if (likely(!(flags & IORING_CQE_F_MORE))) {
+            op->handle_.resume();
+        }
+    }
+};
+
+/**
+ * an io_uring polled by a scheduler, register it with
+ * `SQKScheduler::add_poller` or use the worker's own `Uring::local()`.
+ * ops only queue SQEs, each poll submit all of them with one
+ * `io_uring_enter` and reap the CQEs in batches, so a round of tasks
+ * issuing many ops pay a single syscall.
+ *
+ * a ring belong to one worker, SQEs are never queued from another thread.
+ */
+struct Uring {
+    /* max CQEs reaped by one poll */
+    static constexpr uint32_t CQE_BATCH = 64;
+    /* slots of the fixed file table */
+    static constexpr uint32_t FIXED_FILES = 1024;
+    /* submissions tried to make room in a full SQ before giving up */
+    static constexpr uint32_t SQ_FULL_RETRIES = 4;
+
+    explicit Uring(const UringParams& params = {}) {
+        io_uring_params setup {};
+        if (params.sqpoll_) {
+            setup.flags |= IORING_SETUP_SQPOLL;
+            setup.sq_thread_idle = params.sq_idle_ms_;
+            if (params.sq_cpu_ >= 0) {
+                setup.flags |= IORING_SETUP_SQ_AFF;
+                setup.sq_thread_cpu = params.sq_cpu_;
+            }
+        }
+        int rc = io_uring_queue_init_params(params.entries_, &ring_, &setup);
+        if (rc < 0) {
+            throw std::system_error(-rc, std::system_category());
+        }
+    }
+
+    Uring(Uring&) = delete;
+    Uring& operator=(Uring&) = delete;
+
+    ~Uring() {
+        io_uring_queue_exit(&ring_);
+        if (event_fd_ >= 0) {
+            close(event_fd_);
+        }
+    }
+
+    /**
+     * ring of the calling worker, set up with `local_params` and registered
+     * as its poller on first use.
+     */
+    static Uring& local() {
+        static thread_local std::unique_ptr<Uring> ring;
+        if (unlikely(!ring)) {
+            ring = std::make_unique<Uring>(local_params_);
+            scheduler->add_poller(*ring);
+        }
+        return *ring;
+    }
+
+    /* params of the rings `local` create from now on */
+    static void set_local_params(const UringParams& params) {
+        local_params_ = params;
+    }
+
+    UringOp read(int fd, void* buf, uint32_t len, uint64_t offset) {
+        UringOp op(*this, UringOp::Op::READ);
+        op.fd_ = fd;
+        op.buf_ = buf;
+        op.len_ = len;
+        op.offset_ = offset;
+        return op;
+    }
+
+    UringOp write(int fd, const void* buf, uint32_t len, uint64_t offset) {
+        UringOp op(*this, UringOp::Op::WRITE);
+        op.fd_ = fd;
+        op.buf_ = const_cast<void*>(buf);
+        op.len_ = len;
+        op.offset_ = offset;
+        return op;
+    }
+
+    UringOp recv(int fd, void* buf, uint32_t len, int flags = 0) {
+        UringOp op(*this, UringOp::Op::RECV);
+        op.fd_ = fd;
+        op.buf_ = buf;
+        op.len_ = len;
+        op.flags_ = flags;
+        return op;
+    }
+
+    UringOp send(int fd, const void* buf, uint32_t len, int flags = 0) {
+        UringOp op(*this, UringOp::Op::SEND);
+        op.fd_ = fd;
+        op.buf_ = const_cast<void*>(buf);
+        op.len_ = len;
+        op.flags_ = flags;
+        return op;
+    }
+
+    /**
+     * send with the pages of `buf` pinned instead of copied, the op
+     * complete once the kernel released them, and `buf` may be reused.
+     * only pay off for large payloads, the pinning and notification cost
+     * more than copying a few KB.
+     */
+    UringOp send_zc(int fd, const void* buf, uint32_t len, int flags = 0) {
+        auto op = this->send(fd, buf, len, flags);
+        op.op_ = UringOp::Op::SEND_ZC;
+        return op;
+    }
+
+    /* `msg` must stay valid until the op complete */
+    UringOp sendmsg(int fd, msghdr* msg, int flags = 0) {
+        UringOp op(*this, UringOp::Op::SENDMSG);
+        op.fd_ = fd;
+        op.msg_ = msg;
+        op.flags_ = flags;
+        return op;
+    }
+
+    UringOp recvmsg(int fd, msghdr* msg, int flags = 0) {
+        auto op = this->sendmsg(fd, msg, flags);
+        op.op_ = UringOp::Op::RECVMSG;
+        return op;
+    }
+
+    /* return the accepted fd, `addr` may be null */
+    UringOp accept(
+        int fd,
+        sockaddr* addr = nullptr,
+        socklen_t* addrlen = nullptr,
+        int flags = SOCK_CLOEXEC
+    ) {
+        UringOp op(*this, UringOp::Op::ACCEPT);
+        op.fd_ = fd;
+        op.addr_ = addr;
+        op.addrlen_ = addrlen;
+        op.flags_ = flags;
+        return op;
+    }
+
+    UringOp connect(int fd, const sockaddr* addr, socklen_t addrlen) {
+        UringOp op(*this, UringOp::Op::CONNECT);
+        op.fd_ = fd;
+        op.addr_ = const_cast<sockaddr*>(addr);
+        op.socklen_ = addrlen;
+        return op;
+    }
+
+    /* complete with -ETIME once `timeout` elapsed */
+    UringOp timeout(std::chrono::nanoseconds timeout) {
+        UringOp op(*this, UringOp::Op::TIMEOUT);
+        op.ts_.tv_sec = timeout.count() / 1000000000;
+        op.ts_.tv_nsec = timeout.count() % 1000000000;
+        return op;
+    }
+
+    /**
+     * arm a multishot accept, every accepted fd is a CQE of `stream` until
+     * it is cancelled or fail.
+     */
+    inline void accept_multishot(int fd, UringStream& stream);
+
+    /**
+     * arm a multishot recv, every message land in a buffer picked from
+     * `bufs` and is a CQE of `stream`. the op end, without `more`, on EOF,
+     * error or with -ENOBUFS once `bufs` run dry, re-arm it after
+     * recycling buffers.
+     */
+    inline void recv_multishot(int fd, BufRing& bufs, UringStream& stream);
+
+    /**
+     * cancel the op(s) completing to `completion`, which still get their
+     * CQE, -ECANCELED unless they completed meanwhile.
+     */
+    void cancel(UringCompletion* completion) {
+        static UringCompletion ignore {[](UringCompletion*, int, uint32_t) {}};
+        auto sqe = this->get_sqe(&ignore);
+        if (unlikely(sqe == nullptr)) {
+            S_WARN("io_uring cancel dropped, SQ full");
+            return;
+        }
+        io_uring_prep_cancel(sqe, completion, IORING_ASYNC_CANCEL_ALL);
+    }
+
+    /**
+     * register `iovs` as the fixed buffers of the ring, IOs on them skip
+     * pinning the pages on every submission. a ring has a single set of
+     * fixed buffers, return a negative errno if already registered.
+     */
+    int register_buffers(const iovec* iovs, uint32_t n) {
+        return io_uring_register_buffers(&ring_, iovs, n);
+    }
+
+    /**
+     * put `fd` into the fixed file table, ops on the returned index skip
+     * the per-op file reference counting. return a negative errno if the
+     * table is full.
+     */
+    int register_file(int fd) {
+        if (unlikely(fixed_free_.empty())) {
+            if (fixed_registered_) {
+                return -ENFILE;
+            }
+            int rc = io_uring_register_files_sparse(&ring_, FIXED_FILES);
+            if (rc < 0) {
+                return rc;
+            }
+            fixed_registered_ = true;
+            for (uint32_t i = FIXED_FILES; i > 0; i--) {
+                fixed_free_.push_back(i - 1);
+            }
+        }
+        int index = fixed_free_.back();
+        int rc = io_uring_register_files_update(&ring_, index, &fd, 1);
+        if (rc < 0) {
+            return rc;
+        }
+        fixed_free_.pop_back();
+        return index;
+    }
+
+    void unregister_file(int index) {
+        int fd = -1;
+        io_uring_register_files_update(&ring_, index, &fd, 1);
+        fixed_free_.push_back(index);
+    }
+
+    /**
+     * a SQE completing to `completion`, to be submitted by the next poll.
+     * a full SQ is submitted right away to make room. the first SQE queued
+     * kick the ring's poller, an idle ring is not skipped with work queued.
+     *
+     * null if the SQ stay full: the kernel refuse submissions while the CQ
+     * is backed up (-EBUSY), and nothing reap it from here.
+     */
+    io_uring_sqe* get_sqe(UringCompletion* completion) {
+        io_uring_sqe* sqe;
+        uint32_t retries = 0;
+        while (unlikely((sqe = io_uring_get_sqe(&ring_)) == nullptr)) {
+            if (retries++ == SQ_FULL_RETRIES) {
+                return nullptr;
+            }
+            this->submit();
+        }
+        io_uring_sqe_set_data(sqe, completion);
+        if (queued_++ == 0 && scheduler) {
+            scheduler->kick_poller(this);
+        }
+        return sqe;
+    }
+
+    /* submit the queued SQEs and complete up to CQE_BATCH CQEs */
+    int poll() {
+        int work = queued_ ? this->submit() : 0;
+        io_uring_cqe* cqes[CQE_BATCH];
+        uint32_t n = io_uring_peek_batch_cqe(&ring_, cqes, CQE_BATCH);
+        if (n == 0) {
+            return work;
+        }
+        // free the CQ ring first, completions may queue new SQEs
+        struct {
+            UringCompletion* completion_;
+            int res_;
+            uint32_t flags_;
+        } done[CQE_BATCH];
+        for (uint32_t i = 0; i < n; i++) {
+            done[i] = {
+                static_cast<UringCompletion*>(io_uring_cqe_get_data(cqes[i])),
+                cqes[i]->res,
+                cqes[i]->flags,
+            };
+        }
+        io_uring_cq_advance(&ring_, n);
+        for (uint32_t i = 0; i < n; i++) {
+            done[i].completion_->complete_(
+                done[i].completion_,
+                done[i].res_,
+                done[i].flags_
+            );
+        }
+        return work + n;
+    }
+
+    /**
+     * an eventfd the kernel signal on every CQE, set up on first call, so
+     * a worker polling the ring may park until a completion. -1 if it
+     * could not be registered.
+     */
+    int wait_fd() {
+        if (event_fd_ < 0) {
+            int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (fd >= 0 && io_uring_register_eventfd(&ring_, fd) < 0) {
+                close(fd);
+                fd = -1;
+            }
+            event_fd_ = fd;
+        }
+        return event_fd_;
+    }
+
+    io_uring* raw() {
+        return &ring_;
+    }
+
+  private:
+    int submit() {
+        int rc = io_uring_submit(&ring_);
+        if (unlikely(rc < 0)) {
+            // EAGAIN/EBUSY: retried by the next poll once CQEs are reaped
+            S_WARN("io_uring_submit: {}", rc);
+            return 0;
+        }
+        queued_ = 0;
+        return rc;
+    }
+
+    static inline UringParams local_params_ {};
+
+    io_uring ring_;
+    uint32_t queued_ {0}; /**< SQEs not submitted yet */
+    int event_fd_ {-1};
+    bool fixed_registered_ {false};
+    std::vector<int> fixed_free_; /**< free slots of the fixed file table */
+};
+
+inline bool UringOp::await_suspend(std::coroutine_handle<> handle) {
+    auto sqe = ring_.get_sqe(this);
+    if (unlikely(sqe == nullptr)) {
+        res_ = -EBUSY;
+        return false;
+    }
+    handle_ = handle;
+    this->prep(sqe);
+    return true;
+}
+
+inline void UringOp::cancel() {
+    ring_.cancel(this);
+}
+
+/**
+ * the CQEs of a multishot op as an async stream, `co_await stream.next()`
+ * return them in order, and nullopt once the op ended and every CQE was
+ * consumed. CQEs arriving while nobody await are kept until the next
+ * `next`, the awaiting coroutine is resumed right from the poller
+ * otherwise. one armed op thus feed a loop with no re-arming per message.
+ *
+ * the stream must outlive its op: cancel it and drain the stream before
+ * destroying it.
+ */
+struct UringStream: UringCompletion {
+    struct NextAwaiter {
+        UringStream& stream_;
+
+        bool await_ready() const noexcept {
+            return !stream_.cqes_.empty() || !stream_.armed_;
+        }
+
+        void await_suspend(std::coroutine_handle<> handle) noexcept {
+            stream_.waiter_ = handle;
+        }
+
+        std::optional<UringCqe> await_resume() noexcept {
+            if (stream_.cqes_.empty()) {
+                return std::nullopt;
+            }
+            auto cqe = stream_.cqes_.front();
+            stream_.cqes_.pop_front();
+            return cqe;
+        }
+    };
+
+    explicit UringStream(Uring& ring) :
+        UringCompletion {complete},
+        ring_(ring) {}
+
+    UringStream(UringStream&) = delete;
+    UringStream& operator=(UringStream&) = delete;
+
+    ~UringStream() {
+        S_ASSERT(!armed_);
+    }
+
+    NextAwaiter next() {
+        return {*this};
+    }
+
+    bool armed() const {
+        return armed_;
+    }
+
+    void cancel() {
+        if (armed_) {
+            ring_.cancel(this);
+        }
+    }
+
+  private:
+    friend struct Uring;
+
+    /* null if the SQ is full, the stream then end with a -EBUSY CQE */
+    io_uring_sqe* arm() {
+        S_ASSERT(!armed_);
+        auto sqe = ring_.get_sqe(this);
+        if (unlikely(sqe == nullptr)) {
+            cqes_.push_back({-EBUSY, 0});
+            return nullptr;
+        }
+        armed_ = true;
+        return sqe;
+    }
+
+    static void complete(UringCompletion* completion, int res, uint32_t flags) {
+        auto stream = static_cast<UringStream*>(completion);
+        UringCqe cqe {res, flags};
+        stream->cqes_.push_back(cqe);
+        if (!cqe.more()) {
+            stream->armed_ = false;
+        }
+        if (auto waiter = std::exchange(stream->waiter_, nullptr)) {
+            waiter.resume();
+        }
+    }
+
+    Uring& ring_;
+    bool armed_ {false};
+    std::deque<UringCqe> cqes_;
+    std::coroutine_handle<> waiter_ {};
+};
+
+/**
+ * a ring of `entries` provided buffers of `buf_size` bytes registered as
+ * buffer group `group` of a ring, multishot recvs pick a buffer from it
+ * per message. a buffer is lent to its CQE until `recycle` give it back
+ * to the kernel.
+ */
+struct BufRing {
+    BufRing(Uring& ring, uint16_t group, uint16_t entries, uint32_t buf_size) :
+        ring_(ring),
+        group_(group),
+        entries_(entries),
+        buf_size_(buf_size) {
+        S_ASSERT(std::has_single_bit(entries));
+        int rc;
+        br_ = io_uring_setup_buf_ring(ring.raw(), entries, group, 0, &rc);
+        if (br_ == nullptr) {
+            throw std::system_error(-rc, std::system_category());
+        }
+        bufs_ = std::make_unique<uint8_t[]>(std::size_t(entries) * buf_size);
+        for (uint16_t bid = 0; bid < entries; bid++) {
+            this->add(bid, bid);
+        }
+        io_uring_buf_ring_advance(br_, entries);
+    }
+
+    BufRing(BufRing&) = delete;
+    BufRing& operator=(BufRing&) = delete;
+
+    ~BufRing() {
+        io_uring_free_buf_ring(ring_.raw(), br_, entries_, group_);
+    }
+
+    uint16_t group() const {
+        return group_;
+    }
+
+    /* the data a recv CQE put in its buffer */
+    std::span<uint8_t> data(const UringCqe& cqe) {
+        return {this->buffer(cqe.buffer_id()), std::size_t(cqe.res_)};
+    }
+
+    void recycle(uint16_t bid) {
+        this->add(bid, 0);
+        io_uring_buf_ring_advance(br_, 1);
+    }
+
+  private:
+    uint8_t* buffer(uint16_t bid) {
+        return bufs_.get() + std::size_t(bid) * buf_size_;
+    }
+
+    void add(uint16_t bid, int offset) {
+        io_uring_buf_ring_add(
+            br_,
+            this->buffer(bid),
+            buf_size_,
+            bid,
+            io_uring_buf_ring_mask(entries_),
+            offset
+        );
+    }
+
+    Uring& ring_;
+    uint16_t group_;
+    uint16_t entries_;
+    uint32_t buf_size_;
+    io_uring_buf_ring* br_;
+    std::unique_ptr<uint8_t[]> bufs_;
+};
+
+inline void Uring::accept_multishot(int fd, UringStream& stream) {
+    if (auto sqe = stream.arm()) {
+        io_uring_prep_multishot_accept(sqe, fd, nullptr, nullptr, SOCK_CLOEXEC);
+    }
+}
+
+inline void Uring::recv_multishot(int fd, BufRing& bufs, UringStream& stream) {
+    auto sqe = stream.arm();
+    if (unlikely(sqe == nullptr)) {
+        return;
+    }
+    io_uring_prep_recv_multishot(sqe, fd, nullptr, 0, 0);
+    sqe->flags |= IOSQE_BUFFER_SELECT;
+    sqe->buf_group = bufs.group();
+}
 
+} // namespace sqk::net::uring
 
+#endif // !SQK_NET_IO_URING_URING_HPP_
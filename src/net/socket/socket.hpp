@@ -0,0 +1,304 @@
+#ifndef SQK_NET_SOCKET_SOCKET_HPP_
+#define SQK_NET_SOCKET_SOCKET_HPP_
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <system_error>
+#include <utility>
+
+#include "uring.hpp"
+
+namespace sqk::net {
+using uring::Uring;
+using uring::UringOp;
+using uring::UringStream;
+
+/* an IPv4 or IPv6 address and port */
+struct InetAddr {
+    InetAddr() {}
+
+    /* `ip` in text form, throw `std::system_error` if it is not one */
+    InetAddr(const char* ip, uint16_t port) {
+        auto v4 = reinterpret_cast<sockaddr_in*>(&addr_);
+        auto v6 = reinterpret_cast<sockaddr_in6*>(&addr_);
+        if (inet_pton(AF_INET, ip, &v4->sin_addr) == 1) {
+            v4->sin_family = AF_INET;
+            v4->sin_port = htons(port);
+            len_ = sizeof(sockaddr_in);
+        } else if (inet_pton(AF_INET6, ip, &v6->sin6_addr) == 1) {
+            v6->sin6_family = AF_INET6;
+            v6->sin6_port = htons(port);
+            len_ = sizeof(sockaddr_in6);
+        } else {
+            throw std::system_error(EINVAL, std::system_category());
+        }
+    }
+
+    int family() const {
+        return addr_.ss_family;
+    }
+
+    uint16_t port() const {
+        if (family() == AF_INET6) {
+            return ntohs(reinterpret_cast<const sockaddr_in6*>(&addr_)->sin6_port);
+        }
+        return ntohs(reinterpret_cast<const sockaddr_in*>(&addr_)->sin_port);
+    }
+
+    sockaddr* addr() {
+        return reinterpret_cast<sockaddr*>(&addr_);
+    }
+
+    const sockaddr* addr() const {
+        return reinterpret_cast<const sockaddr*>(&addr_);
+    }
+
+    sockaddr_storage addr_ {};
+    socklen_t len_ {sizeof(sockaddr_storage)};
+};
+
+/* an owned socket fd, closed with the object */
+struct Socket {
+    Socket() {}
+
+    explicit Socket(int fd) : fd_(fd) {}
+
+    Socket(Socket&& other) : fd_(std::exchange(other.fd_, -1)) {}
+
+    Socket& operator=(Socket&& other) {
+        if (this != &other) {
+            this->close();
+            fd_ = std::exchange(other.fd_, -1);
+        }
+        return *this;
+    }
+
+    Socket(Socket&) = delete;
+    Socket& operator=(Socket&) = delete;
+
+    ~Socket() {
+        this->close();
+    }
+
+    int fd() const {
+        return fd_;
+    }
+
+    explicit operator bool() const {
+        return fd_ >= 0;
+    }
+
+    void close() {
+        if (fd_ >= 0) {
+            ::close(std::exchange(fd_, -1));
+        }
+    }
+
+    /**
+     * the address the socket is bound to, its port once bound to 0. throw
+     * `std::system_error` on failure
+     */
+    InetAddr local_addr() const {
+        InetAddr addr;
+        if (getsockname(fd_, addr.addr(), &addr.len_) < 0) {
+            throw std::system_error(errno, std::system_category());
+        }
+        return addr;
+    }
+
+    template<typename T>
+    void set_option(int level, int name, T value) {
+        if (setsockopt(fd_, level, name, &value, sizeof(value)) < 0) {
+            throw std::system_error(errno, std::system_category());
+        }
+    }
+
+  protected:
+    /* a non-blocking socket, throw `std::system_error` on failure */
+    static int open(int family, int type) {
+        int fd = ::socket(family, type | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            throw std::system_error(errno, std::system_category());
+        }
+        return fd;
+    }
+
+    static void bind(int fd, const InetAddr& addr) {
+        if (::bind(fd, addr.addr(), addr.len_) < 0) {
+            int err = errno;
+            ::close(fd);
+            throw std::system_error(err, std::system_category());
+        }
+    }
+
+    int fd_ {-1};
+};
+
+/**
+ * a connected TCP socket on the io_uring of the calling worker, `read` and
+ * `write` return the bytes transferred or a negative errno, like `recv`
+ * and `send`, and may transfer less than asked.
+ *
+ * writes of at least `zerocopy_threshold` bytes go out with
+ * IORING_OP_SEND_ZC, the buffer is pinned instead of copied into the
+ * socket and the write complete once the kernel released it. zero copy
+ * need linux 6.0.
+ */
+struct TcpStream: Socket {
+    using Socket::Socket;
+
+    /* connect to `addr`, throw `std::system_error` on failure */
+    static Task<TcpStream> connect(InetAddr addr) {
+        TcpStream stream(Socket::open(addr.family(), SOCK_STREAM));
+        int rc = co_await Uring::local().connect(
+            stream.fd_,
+            addr.addr(),
+            addr.len_
+        );
+        if (rc < 0) {
+            throw std::system_error(-rc, std::system_category());
+        }
+        co_return std::move(stream);
+    }
+
+    UringOp read(void* buf, uint32_t len) {
+        return Uring::local().recv(fd_, buf, len);
+    }
+
+    UringOp write(const void* buf, uint32_t len) {
+        auto& ring = Uring::local();
+        if (len >= zerocopy_threshold_) {
+            return ring.send_zc(fd_, buf, len, MSG_NOSIGNAL);
+        }
+        return ring.send(fd_, buf, len, MSG_NOSIGNAL);
+    }
+
+    /* disable Nagle, small writes leave without waiting for acks */
+    void set_nodelay(bool on = true) {
+        this->set_option<int>(IPPROTO_TCP, TCP_NODELAY, on);
+    }
+
+    void shutdown(int how = SHUT_WR) {
+        ::shutdown(fd_, how);
+    }
+
+    /* min write size sent zero copy, UINT32_MAX to always copy */
+    static void set_zerocopy_threshold(uint32_t bytes) {
+        zerocopy_threshold_ = bytes;
+    }
+
+  private:
+    static inline uint32_t zerocopy_threshold_ {16U << 10};
+};
+
+/**
+ * a listening TCP socket, `co_await listener.accept()` return the next
+ * connection and throw `std::system_error` on failure. `incoming` arm a
+ * multishot accept instead, each CQE of the stream being an accepted fd
+ * or a negative errno.
+ */
+struct TcpListener: Socket {
+    struct AcceptOp: UringOp {
+        TcpStream await_resume() const {
+            if (res_ < 0) {
+                throw std::system_error(-res_, std::system_category());
+            }
+            return TcpStream(res_);
+        }
+    };
+
+    /* bind and listen on `addr`, throw `std::system_error` on failure */
+    static TcpListener bind(const InetAddr& addr, int backlog = SOMAXCONN) {
+        int fd = Socket::open(addr.family(), SOCK_STREAM);
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        Socket::bind(fd, addr);
+        if (::listen(fd, backlog) < 0) {
+            int err = errno;
+            ::close(fd);
+            throw std::system_error(err, std::system_category());
+        }
+        return TcpListener(fd);
+    }
+
+    AcceptOp accept() {
+        return {Uring::local().accept(fd_, nullptr, nullptr, SOCK_CLOEXEC)};
+    }
+
+    void incoming(UringStream& stream) {
+        Uring::local().accept_multishot(fd_, stream);
+    }
+
+  private:
+    using Socket::Socket;
+};
+
+/**
+ * a UDP socket, `send_to` and `recv_from` return the bytes transferred or
+ * a negative errno. `recv_from` fill `from` with the sender.
+ */
+struct UdpSocket: Socket {
+    /* sendmsg/recvmsg of a single buffer, the msghdr live in the op */
+    struct MsgOp: UringOp {
+        MsgOp(UringOp op, void* buf, uint32_t len, InetAddr* peer) :
+            UringOp(op),
+            iov_ {buf, len},
+            peer_(peer) {}
+
+        bool await_suspend(std::coroutine_handle<> handle) {
+            // the op may have moved since built, point the msghdr now
+            hdr_ = {};
+            hdr_.msg_iov = &iov_;
+            hdr_.msg_iovlen = 1;
+            hdr_.msg_name = peer_->addr();
+            hdr_.msg_namelen = peer_->len_;
+            msg_ = &hdr_;
+            return UringOp::await_suspend(handle);
+        }
+
+        int await_resume() const noexcept {
+            if (op_ == Op::RECVMSG && res_ >= 0) {
+                peer_->len_ = hdr_.msg_namelen;
+            }
+            return res_;
+        }
+
+        iovec iov_;
+        msghdr hdr_ {};
+        InetAddr* peer_;
+    };
+
+    /* bind to `addr`, throw `std::system_error` on failure */
+    static UdpSocket bind(const InetAddr& addr) {
+        int fd = Socket::open(addr.family(), SOCK_DGRAM);
+        Socket::bind(fd, addr);
+        return UdpSocket(fd);
+    }
+
+    /* `to` must stay valid until the op complete */
+    MsgOp send_to(const void* buf, uint32_t len, const InetAddr& to) {
+        return MsgOp(
+            Uring::local().sendmsg(fd_, nullptr),
+            const_cast<void*>(buf),
+            len,
+            const_cast<InetAddr*>(&to)
+        );
+    }
+
+    MsgOp recv_from(void* buf, uint32_t len, InetAddr& from) {
+        from.len_ = sizeof(from.addr_);
+        return MsgOp(Uring::local().recvmsg(fd_, nullptr), buf, len, &from);
+    }
+
+  private:
+    using Socket::Socket;
+};
+
+} // namespace sqk::net
+
+#endif // !SQK_NET_SOCKET_SOCKET_HPP_
@@ -2,11 +2,72 @@
 
 #include <deque>
 #include <list>
+#include <string>
+#include <vector>
 
 #include "ring.hpp"
+#include "slot_ring.hpp"
 
 using namespace sqk::common;
 
+template<size_t N>
+struct Payload {
+    char data_[N];
+};
+
+// typed slots carry the payload itself, the pointer ring pays a heap
+// allocation per element instead
+template<size_t N>
+void payload_bench(uint64_t iterations) {
+    using Elem = Payload<N>;
+    auto suffix = " payload=" + std::to_string(N) + "B";
+    {
+        RingGuard<SlotRing<Elem>> guard(9216);
+        ankerl::nanobench::Bench()
+            .minEpochIterations(iterations)
+            .run("slot_ring" + suffix, [&] {
+                guard->emplace(Elem {{1}});
+                Elem out;
+                guard->dequeue(out);
+                ankerl::nanobench::doNotOptimizeAway(out.data_[0]);
+            });
+    }
+    {
+        RingGuard<Ring<
+            Elem*,
+            RingSyncType::SQK_RING_SYNC_MT,
+            RingSyncType::SQK_RING_SYNC_MT>>
+            guard(9216);
+        ankerl::nanobench::Bench()
+            .minEpochIterations(iterations)
+            .run("pointer mpmc_ring" + suffix, [&] {
+                guard->enqueue(new Elem {{1}});
+                Elem* out;
+                guard->dequeue(out);
+                ankerl::nanobench::doNotOptimizeAway(out->data_[0]);
+                delete out;
+            });
+    }
+}
+
+// enqueue and dequeue bursts of a few sizes, timed per element
+template<typename RingT>
+void burst_bench(const char* name, uint64_t iterations) {
+    for (uint32_t burst : {1, 8, 32, 128}) {
+        RingGuard<RingT> guard(9216);
+        std::vector<uint64_t> in(burst, 1), out(burst);
+        ankerl::nanobench::Bench()
+            .minEpochIterations(iterations / burst)
+            .batch(burst)
+            .unit("elem")
+            .run(std::string(name) + " burst=" + std::to_string(burst), [&] {
+                guard->enqueue_burst(in);
+                auto n = guard->dequeue_burst(out);
+                ankerl::nanobench::doNotOptimizeAway(n);
+            });
+    }
+}
+
 int main(int argc, char* argv[]) {
     constexpr uint64_t iterations = 1UL * 1000 * 1000 * 10;
     {
@@ -50,6 +111,21 @@ int main(int argc, char* argv[]) {
                 ankerl::nanobench::doNotOptimizeAway(i);
             });
     }
+    {
+        RingGuard<Ring<
+            int,
+            RingSyncType::SQK_RING_SYNC_MT_RTS,
+            RingSyncType::SQK_RING_SYNC_ST>>
+            guard(9216);
+        ankerl::nanobench::Bench()
+            .minEpochIterations(iterations)
+            .run("rts mpsc_ring enqueue", [&] {
+                guard->enqueue(1);
+                int i;
+                guard->dequeue(i);
+                ankerl::nanobench::doNotOptimizeAway(i);
+            });
+    }
     {
         std::deque<int> deq;
         ankerl::nanobench::Bench()
@@ -113,6 +189,21 @@ int main(int argc, char* argv[]) {
                 ankerl::nanobench::doNotOptimizeAway(i);
             });
     }
+    {
+        RingGuard<Ring<
+            uint64_t,
+            RingSyncType::SQK_RING_SYNC_MT_RTS,
+            RingSyncType::SQK_RING_SYNC_ST>>
+            guard(9216);
+        ankerl::nanobench::Bench()
+            .minEpochIterations(iterations)
+            .run("rts mpsc_ring enqueue", [&] {
+                guard->enqueue(1);
+                uint64_t i;
+                guard->dequeue(i);
+                ankerl::nanobench::doNotOptimizeAway(i);
+            });
+    }
     {
         std::deque<uint64_t> deq;
         ankerl::nanobench::Bench()
@@ -135,6 +226,21 @@ int main(int argc, char* argv[]) {
                 ankerl::nanobench::doNotOptimizeAway(i);
             });
     }
+    burst_bench<MpscRing<uint64_t>>("mpsc_ring", iterations);
+    burst_bench<Ring<
+        uint64_t,
+        RingSyncType::SQK_RING_SYNC_ST,
+        RingSyncType::SQK_RING_SYNC_ST>>("spsc_ring", iterations);
+    burst_bench<Ring<
+        uint64_t,
+        RingSyncType::SQK_RING_SYNC_MT_HTS,
+        RingSyncType::SQK_RING_SYNC_ST>>("hts mpsc_ring", iterations);
+    burst_bench<Ring<
+        uint64_t,
+        RingSyncType::SQK_RING_SYNC_MT_RTS,
+        RingSyncType::SQK_RING_SYNC_ST>>("rts mpsc_ring", iterations);
+    payload_bench<64>(iterations);
+    payload_bench<256>(iterations);
 
     return 0;
 }
@@ -1,7 +1,90 @@
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
 #include "ring.hpp"
+#include "slot_ring.hpp"
 
 using namespace sqk::common;
 
+// every producer push [1, cnt] in bursts, consumers must pop them all once
+template<typename RingType>
+int stress(uint32_t producers, uint32_t consumers, uint64_t cnt) {
+    RingGuard<RingType> guard(256);
+    std::atomic<uint64_t> sum {}, popped {};
+    std::vector<std::jthread> threads;
+    for (uint32_t p = 0; p < producers; p++) {
+        threads.emplace_back([&]() {
+            uint64_t burst[8];
+            for (uint64_t i = 1; i <= cnt;) {
+                uint32_t n = std::min<uint64_t>(8, cnt - i + 1);
+                for (uint32_t j = 0; j < n; j++) {
+                    burst[j] = i + j;
+                }
+                i += guard.ring_->enqueue_burst(std::span(burst, n));
+            }
+        });
+    }
+    for (uint32_t c = 0; c < consumers; c++) {
+        threads.emplace_back([&]() {
+            uint64_t burst[8];
+            while (popped.load() < producers * cnt) {
+                uint32_t n = guard.ring_->dequeue_burst(burst);
+                uint64_t local = 0;
+                for (uint32_t j = 0; j < n; j++) {
+                    local += burst[j];
+                }
+                sum += local;
+                popped += n;
+            }
+        });
+    }
+    threads.clear();
+    if (sum != producers * cnt * (cnt + 1) / 2) {
+        S_ERROR("sum={}, popped={}", sum.load(), popped.load());
+        return 1;
+    }
+    return 0;
+}
+
+// same as `stress` but every element is an owning pointer moved through
+int slot_stress(uint32_t producers, uint32_t consumers, uint64_t cnt) {
+    using RingType = SlotRing<std::unique_ptr<uint64_t>>;
+    RingGuard<RingType> guard(256);
+    std::atomic<uint64_t> sum {}, popped {};
+    std::vector<std::jthread> threads;
+    for (uint32_t p = 0; p < producers; p++) {
+        threads.emplace_back([&]() {
+            for (uint64_t i = 1; i <= cnt;) {
+                auto elem = std::make_unique<uint64_t>(i);
+                while (!guard.ring_->enqueue(std::move(elem))) {
+                    std::this_thread::yield();
+                }
+                i++;
+            }
+        });
+    }
+    for (uint32_t c = 0; c < consumers; c++) {
+        threads.emplace_back([&]() {
+            std::unique_ptr<uint64_t> elem;
+            while (popped.load() < producers * cnt) {
+                if (guard.ring_->dequeue(elem)) {
+                    sum += *elem;
+                    popped++;
+                }
+            }
+        });
+    }
+    threads.clear();
+    if (sum != producers * cnt * (cnt + 1) / 2) {
+        S_ERROR("slot sum={}, popped={}", sum.load(), popped.load());
+        return 1;
+    }
+    return 0;
+}
+
 int main(int argc, char* argv[]) {
     S_LOGGER_SETUP;
     {
@@ -60,6 +143,196 @@ int main(int argc, char* argv[]) {
             return 1;
         }
     }
+    {
+        auto ring = Ring<
+            int,
+            RingSyncType::SQK_RING_SYNC_MT,
+            RingSyncType::SQK_RING_SYNC_MT>::of(10);
+        int in[32], out[32] {};
+        for (int i = 0; i < 32; i++) {
+            in[i] = i;
+        }
+        // capacity is 15, bulk must not enqueue partially
+        uint32_t n = ring->enqueue_bulk(std::span(in, 16));
+        if (n != 0) {
+            S_ERROR("enqueue_bulk n={}", n);
+            return 1;
+        }
+        n = ring->enqueue_burst(std::span(in, 16));
+        if (n != 15) {
+            S_ERROR("enqueue_burst n={}", n);
+            return 1;
+        }
+        n = ring->dequeue_bulk(std::span(out, 16));
+        if (n != 0) {
+            S_ERROR("dequeue_bulk n={}", n);
+            return 1;
+        }
+        n = ring->dequeue_burst(std::span(out, 8));
+        n += ring->dequeue_burst(std::span(out + 8, 16));
+        std::remove_reference_t<decltype(*ring)>::free(ring);
+        for (int i = 0; i < 15; i++) {
+            if (out[i] != i) {
+                S_ERROR("out[{}]={}", i, out[i]);
+                return 1;
+            }
+        }
+        if (n != 15) {
+            S_ERROR("dequeue_burst n={}", n);
+            return 1;
+        }
+    }
+    {
+        auto ring = Ring<
+            uint64_t,
+            RingSyncType::SQK_RING_SYNC_MT_HTS,
+            RingSyncType::SQK_RING_SYNC_MT_HTS>::of(100);
+        uint64_t in[100], out[100] {};
+        for (uint64_t i = 0; i < 100; i++) {
+            in[i] = i;
+        }
+        uint64_t sum = 0;
+        // wrap around the end of the ring several times
+        for (int round = 0; round < 10; round++) {
+            uint32_t n = ring->enqueue_bulk(std::span(in, 100));
+            if (n != 100) {
+                S_ERROR("enqueue_bulk n={}", n);
+                return 1;
+            }
+            n = ring->dequeue_bulk(std::span(out, 100));
+            if (n != 100) {
+                S_ERROR("dequeue_bulk n={}", n);
+                return 1;
+            }
+            for (uint64_t i = 0; i < 100; i++) {
+                sum += out[i];
+            }
+        }
+        std::remove_reference_t<decltype(*ring)>::free(ring);
+        if (sum != 4950 * 10) {
+            S_ERROR("sum={}", sum);
+            return 1;
+        }
+    }
+    {
+        auto ring = Ring<
+            int,
+            RingSyncType::SQK_RING_SYNC_MT_RTS,
+            RingSyncType::SQK_RING_SYNC_MT_RTS>::of(10);
+        ring->enqueue(1);
+        int i = 0xdd;
+        ring->dequeue(i);
+        std::remove_reference_t<decltype(*ring)>::free(ring);
+        if (i != 1) {
+            S_ERROR("i={}", i);
+            return 1;
+        }
+    }
+    {
+        auto ring = Ring<
+            int,
+            RingSyncType::SQK_RING_SYNC_MT_RTS,
+            RingSyncType::SQK_RING_SYNC_ST>::of(10);
+        ring->set_prod_htd_max(2);
+        int in[4] = {1, 2, 3, 4}, out[4] {};
+        uint32_t n = ring->enqueue_bulk(std::span(in, 4));
+        n += ring->enqueue_bulk(std::span(in, 4));
+        if (n != 8 || ring->count() != 8) {
+            S_ERROR("n={}, count={}", n, ring->count());
+            return 1;
+        }
+        n = ring->dequeue_burst(std::span(out, 4));
+        std::remove_reference_t<decltype(*ring)>::free(ring);
+        if (n != 4 || out[3] != 4) {
+            S_ERROR("n={}, out[3]={}", n, out[3]);
+            return 1;
+        }
+    }
+    {
+        // falls back to THP when no hugepage is reserved
+        MemPolicy policy {
+            MemPolicy::PageType::HUGETLB,
+            MemPolicy::LOCAL_NODE,
+        };
+        auto ring = Ring<
+            uint64_t,
+            RingSyncType::SQK_RING_SYNC_MT,
+            RingSyncType::SQK_RING_SYNC_MT>::of(1 << 18, policy);
+        uint64_t in[64], out[64] {};
+        for (uint64_t i = 0; i < 64; i++) {
+            in[i] = i;
+        }
+        uint32_t n = 0;
+        for (int round = 0; round < (1 << 12); round++) {
+            n += ring->enqueue_bulk(std::span(in, 64));
+        }
+        n -= ring->dequeue_bulk(std::span(out, 64));
+        std::remove_reference_t<decltype(*ring)>::free(ring);
+        if (n != (1 << 18) - 64 || out[63] != 63) {
+            S_ERROR("policy ring n={}, out[63]={}", n, out[63]);
+            return 1;
+        }
+    }
+    {
+        auto ring = SlotRing<std::string>::of(3);
+        uint32_t n = 0;
+        for (int i = 0; i < 5; i++) {
+            n += ring->enqueue(std::string(64, 'a' + i));
+        }
+        std::string out;
+        ring->dequeue(out);
+        // the remaining ones are destroyed by free
+        if (n != 4 || ring->count() != 3 || out != std::string(64, 'a')) {
+            S_ERROR("n={}, count={}, out={}", n, ring->count(), out);
+            std::remove_reference_t<decltype(*ring)>::free(ring);
+            return 1;
+        }
+        std::remove_reference_t<decltype(*ring)>::free(ring);
+    }
+    {
+        struct Odd {
+            char data_[7];
+        };
+        static_assert(sizeof(Odd) % 4 != 0, "");
+        auto ring = SlotRing<Odd>::of(4);
+        ring->emplace(Odd {"sqkio"});
+        Odd out {};
+        ring->dequeue(out);
+        bool ok = ring->empty() && std::string(out.data_) == "sqkio";
+        std::remove_reference_t<decltype(*ring)>::free(ring);
+        if (!ok) {
+            S_ERROR("out={}", out.data_);
+            return 1;
+        }
+    }
+    constexpr uint64_t cnt = 10000;
+    if (stress<Ring<
+            uint64_t,
+            RingSyncType::SQK_RING_SYNC_MT,
+            RingSyncType::SQK_RING_SYNC_MT>>(2, 2, cnt)) {
+        return 1;
+    }
+    if (stress<Ring<
+            uint64_t,
+            RingSyncType::SQK_RING_SYNC_MT_HTS,
+            RingSyncType::SQK_RING_SYNC_MT_HTS>>(2, 2, cnt)) {
+        return 1;
+    }
+    if (stress<Ring<
+            uint64_t,
+            RingSyncType::SQK_RING_SYNC_MT_RTS,
+            RingSyncType::SQK_RING_SYNC_MT_RTS>>(2, 2, cnt)) {
+        return 1;
+    }
+    if (stress<Ring<
+            uint64_t,
+            RingSyncType::SQK_RING_SYNC_MT_RTS,
+            RingSyncType::SQK_RING_SYNC_ST>>(2, 1, cnt)) {
+        return 1;
+    }
+    if (slot_stress(2, 2, cnt)) {
+        return 1;
+    }
 
     return 0;
 }
@@ -31,8 +31,6 @@ struct SqkBench: public Bench {
             pc.updateResults(iterationLogic.numIters());
             iterationLogic.add(after - before, pc);
         }
-
-        sqk::scheduler->stop();
     }
 };
 
@@ -40,6 +38,35 @@ int i;
 
 #define epochIterations (1000UL * 1000)
 
+sqk::Task<int> nested(uint32_t depth) {
+    if (depth == 0) {
+        co_return 0;
+    }
+    int ret = co_await nested(depth - 1);
+    co_return ret + 1;
+}
+
+// `buf` live across the await, so it is part of the coroutine frame
+template<std::size_t N>
+sqk::Task<int> frame() {
+    volatile char buf[N];
+    buf[0] = i;
+    co_await nested(0);
+    co_return buf[0] + buf[N - 1];
+}
+
+template<std::size_t... N>
+sqk::Task<void> frame_sweep(std::index_sequence<N...>) {
+    (co_await SqkBench()
+         .name("frame size=" + std::to_string(N))
+         .minEpochIterations(epochIterations)
+         .run([]() -> sqk::Task<void> {
+             i = co_await frame<N>();
+             doNotOptimizeAway(i);
+         }),
+     ...);
+}
+
 sqk::Task<int> run_bench() {
     co_await SqkBench()
         .name("sqk::scheduler benchmark")
@@ -49,6 +76,23 @@ sqk::Task<int> run_bench() {
             doNotOptimizeAway(i);
             co_return;
         });
+    co_await SqkBench()
+        .name("sqk::scheduler yield benchmark")
+        .minEpochIterations(epochIterations)
+        .run([]() -> sqk::Task<void> { co_yield nullptr; });
+    for (uint32_t depth : {1, 10, 100, 10000}) {
+        co_await SqkBench()
+            .name("nested await depth=" + std::to_string(depth))
+            .minEpochIterations(std::max(epochIterations / depth, 10UL))
+            .run([depth]() -> sqk::Task<void> {
+                i = co_await nested(depth);
+                doNotOptimizeAway(i);
+            });
+    }
+    co_await frame_sweep(
+        std::index_sequence<64, 256, 1 << 10, 4 << 10, 16 << 10, 64 << 10>()
+    );
+    sqk::scheduler->stop();
     co_return 0;
 }
 
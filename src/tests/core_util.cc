@@ -1,5 +1,11 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <iostream>
+#include <set>
+#include <vector>
 
+#include "channel.hpp"
 #include "core.hpp"
 
 using double_t = double;
@@ -64,11 +70,538 @@ sqk::Task<int> catch_throws() {
     exit(1);
 }
 
+std::atomic<bool> stolen_flag;
+
+// spins on its worker until `set_flag` runs, which can only happen when
+// another worker steals it
+sqk::Task<void> wait_flag() {
+    auto deadline =
+        std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (!stolen_flag.load()) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            exit(1);
+        }
+    }
+    co_return;
+}
+
+sqk::Task<void> set_flag(sqk::SQKSchedulerGroup& group) {
+    stolen_flag.store(true);
+    group.stop();
+    co_return;
+}
+
+sqk::Task<int> work_stealing() {
+    sqk::SQKSchedulerGroup group(2);
+    group.spawn_on(0, wait_flag());
+    group.spawn_on(0, set_flag(group));
+    group.start();
+    group.join();
+    exit(stolen_flag.load() ? 0 : 1);
+}
+
+std::atomic<int> runs;
+
+sqk::Task<void> count_run() {
+    runs++;
+    co_return;
+}
+
+// a full run queue turn spawns away, but never drop a woken or yielding
+// coroutine
+sqk::Task<int> run_queue_full() {
+    constexpr int count = 5000;
+    for (int i = 0; i < count; i++) {
+        sqk::scheduler->enqueue(count_run());
+    }
+    while (runs < count) {
+        co_yield nullptr;
+    }
+
+    sqk::SQKSchedulerGroup group(1);
+    int spawned = 0;
+    for (int i = 0; i < count; i++) {
+        auto task = count_run();
+        if (group.spawn_on(0, task) == 0) {
+            spawned++;
+        } else {
+            task.destroy();
+        }
+    }
+    std::cout << "spawned: " << spawned << std::endl;
+    ST_ASSERT(spawned > 0 && spawned < count);
+    group.start();
+    while (runs < count + spawned) {
+        co_yield nullptr;
+    }
+    exit(0);
+}
+
+std::atomic<bool> idle_flag;
+
+sqk::Task<void> set_idle_flag(sqk::SQKSchedulerGroup& group) {
+    idle_flag.store(true);
+    group.stop();
+    co_return;
+}
+
+// workers must park when there is nothing to run, and be woken by spawn
+sqk::Task<int> idle_park() {
+    sqk::SQKSchedulerGroup group(2);
+    group.set_idle_policy({
+        .spin_ = 16,
+        .yield_ = 1,
+        .park_ = true,
+        .park_timeout_ = std::chrono::seconds(5),
+    });
+    group.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    auto before = group.stats();
+    group.spawn_on(0, set_idle_flag(group));
+    group.join();
+    auto after = group.stats();
+    std::cout << "parks: " << after.parks_ << ", wakes: " << after.wakes_
+              << std::endl;
+    exit(idle_flag.load() && before.parks_ >= 2 && after.wakes_ >= 1 ? 0 : 1);
+}
+
+std::atomic<uint32_t> misplaced;
+constexpr uint32_t HOPPERS = 1000;
+std::atomic<uint32_t> hoppers = HOPPERS;
+
+sqk::Task<void> hop(sqk::SQKSchedulerGroup& group) {
+    for (int round = 0; round < 100; round++) {
+        for (uint32_t id = 0; id < group.size(); id++) {
+            co_await sqk::resume_on(group.worker(id));
+            if (sqk::scheduler->id() != id) {
+                misplaced++;
+            }
+            // idle peers steal whatever is queued meanwhile
+            co_yield nullptr;
+        }
+    }
+    if (--hoppers == 0) {
+        group.stop();
+    }
+}
+
+// a coroutine resumed on a worker must land there despite stealing, with
+// far more hops in flight to a worker than it has run queue
+sqk::Task<int> resume_on() {
+    sqk::SQKSchedulerGroup group(4);
+    for (uint32_t i = 0; i < HOPPERS; i++) {
+        group.spawn(hop(group));
+    }
+    group.start();
+    group.join();
+    std::cout << "misplaced: " << misplaced << std::endl;
+    exit(misplaced == 0 ? 0 : 1);
+}
+
+constexpr uint64_t CHANNEL_COUNT = 10000;
+std::atomic<uint64_t> channel_sum;
+std::atomic<uint32_t> channel_receivers = 2;
+
+sqk::Task<void> channel_send(sqk::Channel<uint64_t>& chan) {
+    for (uint64_t i = 1; i <= CHANNEL_COUNT; i++) {
+        co_await chan.send(i);
+    }
+}
+
+sqk::Task<void>
+channel_recv(sqk::Channel<uint64_t>& chan, sqk::SQKSchedulerGroup& group) {
+    for (uint64_t i = 1; i <= CHANNEL_COUNT; i++) {
+        channel_sum += co_await chan.recv();
+    }
+    if (--channel_receivers == 0) {
+        group.stop();
+    }
+}
+
+// a tiny channel make both sides suspend over and over across workers, and
+// another is fed with try_send from the main thread, not a worker
+sqk::Task<int> channel() {
+    sqk::Channel<uint64_t> chan(4), feed(4);
+    sqk::SQKSchedulerGroup group(2);
+    group.spawn_on(0, channel_send(chan));
+    group.spawn_on(1, channel_recv(chan, group));
+    group.spawn_on(0, channel_recv(feed, group));
+    group.start();
+    for (uint64_t i = 1; i <= CHANNEL_COUNT; i++) {
+        while (!feed.try_send(i)) {
+            sqk_pause();
+        }
+    }
+    group.join();
+    exit(channel_sum == CHANNEL_COUNT * (CHANNEL_COUNT + 1) ? 0 : 1);
+}
+
+struct SlabObject: sqk::common::PoolAllocatable<sqk::common::SlabPoolAllocator> {
+    char data_[200];
+};
+
+// objects freed by another thread must go back to the allocating thread,
+// which reuse them instead of growing
+sqk::Task<int> slab_remote_free() {
+    constexpr int count = 1000;
+    std::vector<SlabObject*> objects;
+    std::set<SlabObject*> addresses;
+    for (int i = 0; i < count; i++) {
+        objects.push_back(new SlabObject);
+        addresses.insert(objects.back());
+    }
+    std::jthread([&] {
+        for (auto obj : objects) {
+            delete obj;
+        }
+    }).join();
+    int reused = 0;
+    for (int i = 0; i < count; i++) {
+        objects[i] = new SlabObject;
+        reused += addresses.count(objects[i]);
+    }
+    for (auto obj : objects) {
+        delete obj;
+    }
+    std::cout << "reused: " << reused << std::endl;
+    exit(reused == count ? 0 : 1);
+}
+
+// every block map back to its segment and to a unit of its size class,
+// blocks of a class never overlap and a freed one is handed out next
+sqk::Task<int> slab_lookup() {
+    using sqk::common::SlabPoolAllocator;
+    using sqk::common::SlabSegment;
+    using sqk::common::SlabSizeClass;
+    for (std::size_t size :
+         {1UL, 8UL, 100UL, 129UL, 4000UL, 56UL << 10, 256UL << 10, 300UL << 10}) {
+        std::vector<uint8_t*> blocks(32);
+        for (auto& block : blocks) {
+            block = static_cast<uint8_t*>(SlabPoolAllocator::operator new(size));
+            memset(block, 0xa5, size);
+        }
+        for (auto block : blocks) {
+            auto segment = SlabSegment::of(block);
+            auto& unit = segment->units_[segment->index_of(block)];
+            ST_ASSERT(segment->magic_ == SlabSegment::SLAB_MAGIC);
+            ST_ASSERT(!segment->huge_);
+            if (size > SlabSizeClass::MAX_SIZE) {
+                ST_ASSERT(unit.ind_ == SlabSegment::SPAN_CLASS);
+                ST_ASSERT(unit.span_ << SlabSegment::UNIT_SHIFT >= size);
+            } else {
+                ST_ASSERT(unit.ind_ == SlabSizeClass::index(std::max(size, 8UL)));
+                ST_ASSERT(SlabSizeClass::size(unit.ind_) >= size);
+            }
+        }
+        auto sorted = blocks;
+        std::sort(sorted.begin(), sorted.end());
+        for (size_t i = 1; i < sorted.size(); i++) {
+            ST_ASSERT(sorted[i - 1] + size <= sorted[i]);
+        }
+        if (size <= SlabSizeClass::MAX_SIZE) {
+            auto last = blocks.back();
+            SlabPoolAllocator::operator delete(last);
+            blocks.back() =
+                static_cast<uint8_t*>(SlabPoolAllocator::operator new(size));
+            ST_ASSERT(blocks.back() == last);
+        }
+        for (auto block : blocks) {
+            SlabPoolAllocator::operator delete(block);
+        }
+    }
+    auto huge = SlabPoolAllocator::operator new(4UL << 20);
+    ST_ASSERT(SlabSegment::of(huge)->huge_);
+    SlabPoolAllocator::operator delete(huge);
+    exit(0);
+}
+
+// cached blocks are bounded by their class limit and given back by trim
+sqk::Task<int> slab_trim() {
+    using sqk::common::SlabPoolAllocator;
+    constexpr int count = 100000;
+    constexpr std::size_t limit = 64UL << 10;
+    std::vector<SlabObject*> objects(count);
+    SlabPoolAllocator::set_class_limit(SIZE_MAX);
+    for (auto& obj : objects) {
+        obj = new SlabObject;
+    }
+    for (auto obj : objects) {
+        delete obj;
+    }
+    auto cached = SlabPoolAllocator::stats().cached();
+    auto released = SlabPoolAllocator::trim();
+    auto trimmed = SlabPoolAllocator::stats().cached();
+    SlabPoolAllocator::set_class_limit(
+        sqk::common::SlabSizeClass::index(sizeof(SlabObject)),
+        limit
+    );
+    for (auto& obj : objects) {
+        obj = new SlabObject;
+    }
+    for (auto obj : objects) {
+        delete obj;
+    }
+    auto bounded = SlabPoolAllocator::stats().cached();
+    std::cout << "cached: " << cached << ", released: " << released
+              << ", trimmed: " << trimmed << ", bounded: " << bounded
+              << std::endl;
+    exit(
+        cached >= count * sizeof(SlabObject) && released >= cached
+                && trimmed == 0 && bounded <= 2 * limit
+            ? 0
+            : 1
+    );
+}
+
+struct TlsfObject: sqk::common::TlsfPoolAllocator {
+    char data_[200];
+};
+
+// the pool grow past its first area, and blocks freed by another thread
+// are reused by the owner without mapping more
+sqk::Task<int> tlsf_remote_free() {
+    using sqk::common::TlsfPoolAllocator;
+    constexpr int count = 20000;
+    std::vector<TlsfObject*> objects(count);
+    for (auto& obj : objects) {
+        obj = new TlsfObject;
+    }
+    auto grown = TlsfPoolAllocator::mapped();
+    std::jthread([&] {
+        for (auto obj : objects) {
+            delete obj;
+        }
+    }).join();
+    for (auto& obj : objects) {
+        obj = new TlsfObject;
+    }
+    auto reused = TlsfPoolAllocator::mapped();
+    for (auto obj : objects) {
+        delete obj;
+    }
+    std::cout << "grown: " << grown << ", reused: " << reused << std::endl;
+    exit(grown > (2UL << 20) && reused == grown ? 0 : 1);
+}
+
+// completes one pending IO every 16 polls, resuming it from the poller
+struct FakeCompletionQueue {
+    struct Completion {
+        FakeCompletionQueue& cq_;
+        std::coroutine_handle<> handle_ {};
+
+        bool await_ready() {
+            return false;
+        }
+
+        void await_suspend(std::coroutine_handle<> handle) {
+            handle_ = handle;
+            cq_.pending_.push_back(this);
+        }
+
+        void await_resume() {}
+    };
+
+    std::vector<Completion*> pending_;
+    uint32_t polls_ {};
+
+    Completion submit() {
+        return {*this};
+    }
+
+    int poll() {
+        if (++polls_ % 16 || pending_.empty()) {
+            return 0;
+        }
+        auto completion = pending_.back();
+        pending_.pop_back();
+        completion->handle_.resume();
+        return 1;
+    }
+};
+
+// the scheduler drive registered pollers, and park once they are idle
+sqk::Task<int> poller() {
+    constexpr int count = 100;
+    FakeCompletionQueue cq;
+    sqk::scheduler->set_idle_policy({.spin_ = 1, .yield_ = 1});
+    sqk::scheduler->add_poller(cq);
+    for (int i = 0; i < count; i++) {
+        co_await cq.submit();
+    }
+    sqk::scheduler->remove_poller(&cq);
+    ST_ASSERT(cq.polls_ >= count * 16);
+
+    // a poller idle for long no longer keep the worker from parking
+    FakeCompletionQueue idle;
+    sqk::scheduler->set_idle_policy({.spin_ = 16, .yield_ = 1});
+    sqk::scheduler->add_poller(idle);
+    auto parks = sqk::scheduler->stats().parks_;
+    co_await sqk::sleep_for(std::chrono::milliseconds(50));
+    sqk::scheduler->remove_poller(&idle);
+    parks = sqk::scheduler->stats().parks_ - parks;
+    std::cout << "polls: " << cq.polls_ << ", idle polls: " << idle.polls_
+              << ", parks: " << parks << std::endl;
+    exit(parks > 0 ? 0 : 1);
+}
+
+using namespace std::chrono_literals;
+
+std::vector<int> woken;
+
+sqk::Task<void> sleeper(int ms) {
+    co_await sqk::sleep_for(std::chrono::milliseconds(ms));
+    woken.push_back(ms);
+}
+
+// sleepers wake in deadline order, also across the wheel levels
+sqk::Task<int> sleep() {
+    auto start = std::chrono::steady_clock::now();
+    co_await sqk::sleep_for(5ms);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    ST_ASSERT(elapsed >= 5ms && elapsed < 100ms);
+
+    for (int ms : {30, 2, 300, 11, 1, 120, 7}) {
+        sqk::scheduler->enqueue(sleeper(ms));
+    }
+    start = std::chrono::steady_clock::now();
+    while (woken.size() < 7) {
+        co_yield nullptr;
+    }
+    elapsed = std::chrono::steady_clock::now() - start;
+    for (int ms : woken) {
+        std::cout << ms << " ";
+    }
+    std::cout << "in " << elapsed / 1ms << "ms" << std::endl;
+    ST_ASSERT(std::is_sorted(woken.begin(), woken.end()));
+    ST_ASSERT(elapsed >= 300ms && elapsed < 500ms);
+    exit(0);
+}
+
+uint64_t wheel_clock;
+std::vector<std::pair<int, uint64_t>> wheel_fired;
+
+// a wheel on a fake clock, stepped from deadline to deadline as a parked
+// worker would: each timer fire on its tick, far ones in a few wakeups
+sqk::Task<int> timer_wheel() {
+    using sqk::TimerWheel;
+    constexpr uint64_t tick = 1UL << TimerWheel::TICK_SHIFT;
+    wheel_clock = 1UL << 40;
+    TimerWheel wheel(wheel_clock);
+    auto fire = [](sqk::Timer* timer) {
+        wheel_fired.emplace_back(timer->expires_, wheel_clock);
+    };
+    sqk::Timer timers[] = {
+        sqk::Timer(fire),
+        sqk::Timer(fire),
+        sqk::Timer(fire),
+        sqk::Timer(fire),
+        sqk::Timer(fire),
+    };
+    // level 0, 1, 2, 3 and a cancelled one
+    uint64_t delays[] = {3, 1000, 100000, 30000000, 500};
+    for (int i = 0; i < 5; i++) {
+        wheel.add(&timers[i], wheel_clock + delays[i] * tick);
+    }
+    wheel.cancel(&timers[4]);
+    ST_ASSERT(wheel.size() == 4);
+
+    int wakeups = 0;
+    while (uint64_t due = wheel.next_due(wheel_clock)) {
+        wheel_clock += due;
+        wheel.advance(wheel_clock);
+        wakeups++;
+    }
+    std::cout << "timer wheel: " << wheel_fired.size() << " fired in "
+              << wakeups << " wakeups" << std::endl;
+    ST_ASSERT(wheel_fired.size() == 4);
+    for (auto [expires, at] : wheel_fired) {
+        ST_ASSERT(at >> TimerWheel::TICK_SHIFT == expires);
+    }
+    ST_ASSERT(std::is_sorted(wheel_fired.begin(), wheel_fired.end()));
+    ST_ASSERT(wakeups <= 4 * int(TimerWheel::LEVELS));
+    exit(0);
+}
+
+sqk::Task<int> value_after(std::chrono::nanoseconds delay, int value) {
+    co_await sqk::sleep_for(delay);
+    co_return value;
+}
+
+sqk::Task<void> throws_after(std::chrono::nanoseconds delay) {
+    co_await sqk::sleep_for(delay);
+    throw std::runtime_error("late");
+}
+
+// still busy when the deadline pass, then suspend in the cancelled scope
+sqk::Task<int> sleep_late(std::chrono::nanoseconds busy) {
+    auto until = std::chrono::steady_clock::now() + busy;
+    while (std::chrono::steady_clock::now() < until) {
+        co_yield nullptr;
+    }
+    co_await sqk::sleep_for(10s);
+    co_return 1;
+}
+
+sqk::Task<bool> nested() {
+    auto inner = co_await sqk::with_timeout(value_after(10s, 1), 10s);
+    co_return inner.has_value();
+}
+
+// a deadline cancel the pending sleep, also through a nested scope
+sqk::Task<int> with_timeout() {
+    auto start = std::chrono::steady_clock::now();
+    auto late = co_await sqk::with_timeout(value_after(10s, 1), 10ms);
+    ST_ASSERT(!late);
+    auto on_time = co_await sqk::with_timeout(value_after(1ms, 2), 10s);
+    ST_ASSERT(on_time && *on_time == 2);
+    auto outer = co_await sqk::with_timeout(nested(), 10ms);
+    ST_ASSERT(!outer);
+    bool thrown = false;
+    try {
+        co_await sqk::with_timeout(throws_after(1ms), 10s);
+    } catch (std::runtime_error&) {
+        thrown = true;
+    }
+    ST_ASSERT(thrown);
+    ST_ASSERT(!co_await sqk::with_timeout(throws_after(10s), 1ms));
+    ST_ASSERT(!co_await sqk::with_timeout(sleep_late(20ms), 1ms));
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "with_timeout: " << elapsed / 1ms << "ms" << std::endl;
+    ST_ASSERT(elapsed < 1s);
+    exit(0);
+}
+
 sqk::Task<int> run_test(char* argv[]) {
     if (!strcmp(argv[1], "simple")) {
         return g();
     } else if (!strcmp(argv[1], "exception_propagation")) {
         return catch_throws();
+    } else if (!strcmp(argv[1], "work_stealing")) {
+        return work_stealing();
+    } else if (!strcmp(argv[1], "run_queue_full")) {
+        return run_queue_full();
+    } else if (!strcmp(argv[1], "idle_park")) {
+        return idle_park();
+    } else if (!strcmp(argv[1], "channel")) {
+        return channel();
+    } else if (!strcmp(argv[1], "slab_remote_free")) {
+        return slab_remote_free();
+    } else if (!strcmp(argv[1], "slab_lookup")) {
+        return slab_lookup();
+    } else if (!strcmp(argv[1], "slab_trim")) {
+        return slab_trim();
+    } else if (!strcmp(argv[1], "tlsf_remote_free")) {
+        return tlsf_remote_free();
+    } else if (!strcmp(argv[1], "resume_on")) {
+        return resume_on();
+    } else if (!strcmp(argv[1], "poller")) {
+        return poller();
+    } else if (!strcmp(argv[1], "sleep")) {
+        return sleep();
+    } else if (!strcmp(argv[1], "timer_wheel")) {
+        return timer_wheel();
+    } else if (!strcmp(argv[1], "with_timeout")) {
+        return with_timeout();
     }
     ST_ASSERT(0);
 }
@@ -83,26 +83,8 @@ int main() {
     keys.rkey = mr.key();
     keys.addr = (uint64_t)buf.buf_;
 
-    sqk::scheduler->enqueue([](EventQueue& eq) -> sqk::Task<void> {
-        Event event;
-        int rc;
-        EventQueueCompleteEntry ent;
-        for (;;) {
-            rc = eq.poll(event, 0);
-            co_yield nullptr;
-        }
-        co_return;
-    }(eq));
-
-    sqk::scheduler->enqueue([](CompletionQueue& cq) -> sqk::Task<void> {
-        CompletionQueueMsgEntry cqe;
-        for (;;) {
-            int rc;
-            rc = cq.poll();
-            co_yield nullptr;
-        }
-        co_return;
-    }(cq));
+    sqk::scheduler->add_poller(eq);
+    sqk::scheduler->add_poller(cq);
 
     sqk::scheduler->enqueue(run(fabric, info, eq, cq, domain, keys, buf, mr));
     sqk::scheduler->run();
@@ -38,26 +38,8 @@ run(Fabric& fabric,
         auto flag = 0;
     }
 
-    sqk::scheduler->enqueue([](EventQueue& eq) -> sqk::Task<void> {
-        Event event;
-        int rc;
-        EventQueueCompleteEntry ent;
-        for (;;) {
-            rc = eq.poll(event, 0);
-            co_yield nullptr;
-        }
-        co_return;
-    }(eq));
-
-    sqk::scheduler->enqueue([](CompletionQueue& cq) -> sqk::Task<void> {
-        CompletionQueueMsgEntry cqe;
-        for (;;) {
-            int rc;
-            rc = cq.poll();
-            co_yield nullptr;
-        }
-        co_return;
-    }(cq));
+    sqk::scheduler->add_poller(eq);
+    sqk::scheduler->add_poller(cq);
 
     Endpoint* ep;
     if (!send_first) {
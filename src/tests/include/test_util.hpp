@@ -0,0 +1,39 @@
+#ifndef SQK_TESTS_TEST_UTIL_HPP_
+#define SQK_TESTS_TEST_UTIL_HPP_
+
+#include "core.hpp"
+
+namespace sqk::test {
+
+inline int failures;
+
+/**
+ * run `test()` as a task on a scheduler of the calling thread, return 1 if
+ * any `CHECK` failed
+ */
+template<typename F>
+int run(const char* name, F&& test) {
+    scheduler = new SQKScheduler;
+    auto task = [&]() -> Task<void> {
+        co_await test();
+        S_INFO("{} test failures: {}", name, failures);
+        scheduler->stop();
+    };
+    scheduler->enqueue(task());
+    scheduler->run();
+    delete scheduler;
+    return failures ? 1 : 0;
+}
+
+} // namespace sqk::test
+
+/* log a failed check and go on with the test */
+#define CHECK(cond)                                                            \
+    do {                                                                       \
+        if (!(cond)) {                                                         \
+            S_ERROR("check failed: {}", #cond);                                \
+            sqk::test::failures++;                                             \
+        }                                                                      \
+    } while (0)
+
+#endif // !SQK_TESTS_TEST_UTIL_HPP_
@@ -0,0 +1,138 @@
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+#include "blob.hpp"
+using namespace sqk::io::blob;
+
+const char* dpdk_cli_override_opts =
+    "--log-level=lib.eal:4 "
+    "--log-level=lib.malloc:4 "
+    "--log-level=lib.ring:4 "
+    "--log-level=lib.mempool:4 "
+    "--log-level=pmd:4 "
+    "--no-telemetry";
+
+constexpr uint32_t queue_depth = 32;
+constexpr uint64_t ios = 1 << 20;
+
+// the former read path: a coroutine frame per IO, completed by `common_cb`
+// waking an Awaker through the run queue
+sqk::Task<int> read_task(Blob& blob, DmaBuf& buf, size_t offset) {
+    auto io = blob.read(buf, offset, 1);
+    sqk::Awaker<int> awaker;
+    spdk_blob_io_read(
+        io.blob_,
+        io.channel_,
+        io.buf_,
+        io.offset_,
+        io.length_,
+        common_cb,
+        &awaker
+    );
+    int rc = co_await awaker;
+    co_return rc;
+}
+
+uint32_t stride;
+
+template<bool Framed>
+sqk::Task<void> reader(
+    Blob& blob,
+    DmaBuf& buf,
+    uint64_t units,
+    uint32_t id,
+    std::atomic<uint64_t>& remaining
+) {
+    for (uint64_t i = id; i < ios; i += stride) {
+        int rc;
+        if constexpr (Framed) {
+            rc = co_await read_task(blob, buf, i % units);
+        } else {
+            rc = co_await blob.read(buf, i % units, 1);
+        }
+        S_ASSERT(rc == 0);
+        remaining--;
+    }
+}
+
+// `queue_depth` readers of one io unit per worker, return the IOPS
+template<bool Framed>
+sqk::Task<double> run(
+    sqk::SQKSchedulerGroup& group,
+    Blob& blob,
+    std::vector<DmaBuf>& bufs,
+    uint64_t units
+) {
+    std::atomic<uint64_t> remaining = ios;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t id = 0; id < bufs.size(); id++) {
+        group.spawn_on(
+            id / queue_depth,
+            reader<Framed>(blob, bufs[id], units, id, remaining)
+        );
+    }
+    while (remaining) {
+        co_yield nullptr;
+    }
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    co_return ios / elapsed.count();
+}
+
+// usage: blob_bench [core mask], one worker and reactor per core
+int main(int argc, char* argv[]) {
+    S_LOGGER_SETUP;
+    BlobEnv env;
+    BlobOptions opts;
+    opts.name = "blob_bench";
+    opts.env_context = const_cast<char*>(dpdk_cli_override_opts);
+    opts.conf_file = "../src/tests/io/blob/hello_blob.json";
+    if (argc > 1) {
+        opts.core_mask = argv[1];
+    }
+    auto cpus = opts.cpus();
+    sqk::SQKSchedulerGroup group(cpus.size(), cpus);
+    stride = queue_depth * group.size();
+
+    auto bench = [](sqk::SQKSchedulerGroup& group,
+                    BlobEnv& env,
+                    BlobOptions& opts) -> sqk::Task<void> {
+        co_await env.setup(opts);
+        co_await env.start_reactors(group);
+        auto blob_dev = env.make_blob_dev("Malloc0");
+        auto bs = co_await blob_dev.init_blobstore();
+        auto unit_size = bs.get_io_unit_size();
+
+        auto blob = co_await bs.make_blob();
+        co_await blob.resize(bs.free_cluster_count());
+        co_await blob.sync_meta_data();
+        auto units =
+            blob.get_num_clusters() * bs.get_cluster_size() / unit_size;
+
+        std::vector<DmaBuf> bufs(stride);
+        for (auto& buf : bufs) {
+            buf = DmaPool::get(unit_size);
+        }
+        auto framed = co_await run<true>(group, blob, bufs, units);
+        auto direct = co_await run<false>(group, blob, bufs, units);
+        S_INFO(
+            "blob read {} workers, qd {}: task {:.0f} IOPS, "
+            "awaiter {:.0f} IOPS",
+            group.size(),
+            stride,
+            framed,
+            direct
+        );
+        bufs.clear();
+        co_await bs.release_channels(group);
+        co_await blob.close();
+        co_await bs.unload();
+        co_await env.stop_reactors(group);
+        group.stop();
+    };
+    group.spawn_on(0, bench(group, env, opts));
+    group.start();
+    group.join();
+    return 0;
+}
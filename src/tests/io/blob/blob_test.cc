@@ -55,22 +55,50 @@ int main(int argc, char* argv[]) {
             co_await blob.resize(free);
             co_await blob.sync_meta_data();
 
-            auto write_buf = dma_alloc(unit_size, 0x1000);
-            memset(write_buf, 0x5a, unit_size);
+            auto write_buf = DmaPool::get(unit_size);
+            memset(write_buf.data(), 0x5a, unit_size);
             co_await blob.write(write_buf, 0, 1);
 
-            auto read_buf = dma_alloc(unit_size, 0x1000);
+            auto read_buf = DmaPool::get(unit_size);
             co_await blob.read(read_buf, 0, 1);
 
-            auto cmp_res = memcmp(write_buf, read_buf, unit_size);
+            auto cmp_res = memcmp(write_buf.data(), read_buf.data(), unit_size);
             S_INFO("blob test: {}", cmp_res);
+
+            // a released buffer is handed out again by the thread's pool
+            auto addr = read_buf.data();
+            read_buf.reset();
+            read_buf = DmaPool::get(unit_size);
+            S_INFO("dma pool reuse: {}", read_buf.data() == addr);
+
+            // one gathered write of two segments, read back by a batch, the
+            // segments are out of address order to check the gather order
+            auto vec_pool_buf = DmaPool::get(2 * unit_size);
+            auto vec_buf = vec_pool_buf.data();
+            memset(vec_buf, 0xa5, unit_size);
+            memset(vec_buf + unit_size, 0x3c, unit_size);
+            iovec iov[2] = {
+                {vec_buf + unit_size, unit_size},
+                {vec_buf, unit_size},
+            };
+            co_await blob.writev(iov, 2, 1, 2);
+            sqk::io::blob::BlobIoBatch<2> batch;
+            batch.add(blob.read(read_buf, 1, 1));
+            batch.add(blob.read(write_buf, 2, 1));
+            int rc = co_await batch.wait(1);
+            rc |= co_await batch.wait();
+            cmp_res = memcmp(vec_buf + unit_size, read_buf.data(), unit_size)
+                | memcmp(vec_buf, write_buf.data(), unit_size);
+            S_INFO("blob vectored test: {}, {}", rc, cmp_res);
+            bs.release_channel();
+            rc = co_await blob.close();
+            rc |= co_await bs.unload();
+            S_INFO("blob unload: {}", rc);
             sqk::scheduler->stop();
         };
-        sqk::scheduler->enqueue(task(env));
-        for (;;) {
-            loop.poll();
-            co_yield nullptr;
-        }
+        sqk::scheduler->add_poller(loop);
+        co_await task(env);
+        sqk::scheduler->remove_poller(&loop);
     };
     sqk::scheduler->enqueue(loop_task(env, opts));
     sqk::scheduler->run();
@@ -0,0 +1,124 @@
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "file.hpp"
+using sqk::io::File;
+
+constexpr uint32_t block = 4096;
+constexpr uint64_t file_size = 256UL << 20;
+constexpr uint32_t queue_depth = 32;
+constexpr uint64_t ios = 1 << 18;
+const char* path = "sqk_file_bench.dat";
+
+std::vector<uint64_t> offsets() {
+    std::mt19937_64 rng(42);
+    std::vector<uint64_t> offsets(ios);
+    for (auto& offset : offsets) {
+        offset = rng() % (file_size / block) * block;
+    }
+    return offsets;
+}
+
+// blocking `pread` from `threads` threads, the thread pool way
+double pread_iops(int fd, uint32_t threads, std::vector<uint64_t>& offsets) {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::jthread> pool;
+    for (uint32_t id = 0; id < threads; id++) {
+        pool.emplace_back([&, id] {
+            auto buf = aligned_alloc(block, block);
+            for (uint64_t i = id; i < ios; i += threads) {
+                auto n = pread(fd, buf, block, offsets[i]);
+                S_ASSERT(n == block);
+                SQK_SET_USED(n);
+            }
+            free(buf);
+        });
+    }
+    pool.clear();
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    return ios / elapsed.count();
+}
+
+sqk::Task<void> reader(
+    File& file,
+    uint32_t id,
+    std::vector<uint64_t>& offsets,
+    uint64_t& remaining
+) {
+    auto buf = aligned_alloc(block, block);
+    for (uint64_t i = id; i < ios; i += queue_depth) {
+        int n = co_await file.read(buf, block, offsets[i]);
+        S_ASSERT(n == block);
+        SQK_SET_USED(n);
+        remaining--;
+    }
+    free(buf);
+}
+
+// `queue_depth` readers on one worker's io_uring
+sqk::Task<double> uring_iops(File& file, std::vector<uint64_t>& offsets) {
+    uint64_t remaining = ios;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t id = 0; id < queue_depth; id++) {
+        sqk::scheduler->enqueue(reader(file, id, offsets, remaining));
+    }
+    while (remaining) {
+        co_yield nullptr;
+    }
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    co_return ios / elapsed.count();
+}
+
+// usage: file_bench [buffered], 4KB random reads, O_DIRECT by default
+int main(int argc, char* argv[]) {
+    S_LOGGER_SETUP;
+    int flags = O_RDWR | O_CREAT | O_TRUNC;
+    if (argc < 2) {
+        flags |= O_DIRECT;
+    }
+    auto file = File::open(path, flags);
+    {
+        auto fill = File::open(path, O_WRONLY);
+        std::vector<uint8_t> chunk(1 << 20, 0x5a);
+        for (uint64_t off = 0; off < file_size; off += chunk.size()) {
+            auto n = pwrite(fill.fd(), chunk.data(), chunk.size(), off);
+            S_ASSERT(n > 0);
+            SQK_SET_USED(n);
+        }
+        fsync(fill.fd());
+    }
+    auto offs = offsets();
+
+    sqk::scheduler = new sqk::SQKScheduler;
+    auto bench = [](File& file,
+                    std::vector<uint64_t>& offsets) -> sqk::Task<void> {
+        auto pread1 = pread_iops(file.fd(), 1, offsets);
+        auto pread_qd = pread_iops(file.fd(), queue_depth, offsets);
+        auto uring = co_await uring_iops(file, offsets);
+        file.register_fixed();
+        auto fixed = co_await uring_iops(file, offsets);
+        S_INFO(
+            "4KB random read: pread {:.0f} IOPS, "
+            "pread x{} threads {:.0f} IOPS, "
+            "uring qd {} {:.0f} IOPS, fixed file {:.0f} IOPS",
+            pread1,
+            queue_depth,
+            pread_qd,
+            queue_depth,
+            uring,
+            fixed
+        );
+        sqk::scheduler->stop();
+    };
+    sqk::scheduler->enqueue(bench(file, offs));
+    sqk::scheduler->run();
+    unlink(path);
+    delete sqk::scheduler;
+    return 0;
+}
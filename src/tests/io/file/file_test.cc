@@ -0,0 +1,54 @@
+#include <sys/uio.h>
+
+#include <cstdlib>
+#include <cstring>
+
+#include "file.hpp"
+#include "test_util.hpp"
+using sqk::io::File;
+using sqk::net::uring::Uring;
+
+constexpr uint32_t block = 4096;
+const char* path = "sqk_file_test.dat";
+
+// O_DIRECT when the filesystem support it, e.g. not on older tmpfs
+File open_direct() {
+    try {
+        return File::open(path, O_RDWR | O_CREAT | O_TRUNC | O_DIRECT);
+    } catch (std::system_error&) {
+        S_WARN("no O_DIRECT support, testing buffered IO");
+        return File::open(path, O_RDWR | O_CREAT | O_TRUNC);
+    }
+}
+
+sqk::Task<void> file_rw() {
+    auto file = open_direct();
+    auto out = static_cast<uint8_t*>(aligned_alloc(block, 2 * block));
+    auto in = out + block;
+    memset(out, 0x5a, block);
+
+    CHECK(co_await file.fallocate(0, 16 * block) == 0);
+    CHECK(co_await file.write(out, block, 3 * block) == block);
+    CHECK(co_await file.fsync(true) == 0);
+    CHECK(co_await file.read(in, block, 3 * block) == block);
+    CHECK(memcmp(in, out, block) == 0);
+
+    // the same through a fixed file and a registered buffer
+    CHECK(file.register_fixed() == 0);
+    iovec iov {out, 2 * block};
+    CHECK(Uring::local().register_buffers(&iov, 1) == 0);
+    memset(out, 0xa5, block);
+    CHECK(co_await file.write_fixed(out, block, 5 * block, 0) == block);
+    memset(in, 0, block);
+    CHECK(co_await file.read_fixed(in, block, 5 * block, 0) == block);
+    CHECK(memcmp(in, out, block) == 0);
+    CHECK(co_await file.fsync() == 0);
+
+    unlink(path);
+    free(out);
+}
+
+int main(int argc, char* argv[]) {
+    S_LOGGER_SETUP;
+    return sqk::test::run("file", file_rw);
+}
@@ -0,0 +1,220 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <unistd.h>
+
+#include <cstring>
+
+#include "test_util.hpp"
+#include "uring.hpp"
+using namespace sqk::net::uring;
+
+sqk::Task<void> pipe_rw(Uring& ring) {
+    int fds[2];
+    int rc = pipe(fds);
+    S_ASSERT(rc == 0);
+    char out[] = "hello uring";
+    char in[sizeof(out)] {};
+    CHECK(co_await ring.write(fds[1], out, sizeof(out), 0) == sizeof(out));
+    CHECK(co_await ring.read(fds[0], in, sizeof(in), 0) == sizeof(in));
+    CHECK(memcmp(in, out, sizeof(out)) == 0);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+sqk::Task<void> acceptor(Uring& ring, int listen_fd, int& peer) {
+    peer = co_await ring.accept(listen_fd);
+}
+
+// connect and accept concurrently over loopback, then echo one message
+sqk::Task<void> tcp(Uring& ring) {
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addrlen = sizeof(addr);
+    int rc = bind(listen_fd, (sockaddr*)&addr, addrlen);
+    rc |= listen(listen_fd, 16);
+    rc |= getsockname(listen_fd, (sockaddr*)&addr, &addrlen);
+    S_ASSERT(rc == 0);
+
+    int peer = -1;
+    sqk::scheduler->enqueue(acceptor(ring, listen_fd, peer));
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    CHECK(co_await ring.connect(fd, (sockaddr*)&addr, addrlen) == 0);
+    while (peer < 0) {
+        co_yield nullptr;
+    }
+
+    char out[] = "ping";
+    char in[sizeof(out)] {};
+    CHECK(co_await ring.send(fd, out, sizeof(out)) == sizeof(out));
+    CHECK(co_await ring.recv(peer, in, sizeof(in)) == sizeof(in));
+    CHECK(memcmp(in, out, sizeof(out)) == 0);
+    close(peer);
+    CHECK(co_await ring.recv(fd, in, sizeof(in)) == 0);
+    close(fd);
+    close(listen_fd);
+}
+
+sqk::Task<void> timeout(Uring& ring) {
+    auto start = std::chrono::steady_clock::now();
+    CHECK(co_await ring.timeout(std::chrono::milliseconds(10)) == -ETIME);
+    CHECK(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(10));
+}
+
+sqk::Task<void> read_pipe(Uring& ring, int fd, int& res) {
+    char byte;
+    res = co_await ring.read(fd, &byte, 1, 0);
+}
+
+// a read nobody write to is cancelled by the deadline
+sqk::Task<void> read_timeout(Uring& ring) {
+    int fds[2];
+    int rc = pipe(fds);
+    S_ASSERT(rc == 0);
+    int res = 0;
+    auto start = std::chrono::steady_clock::now();
+    auto read = co_await sqk::with_timeout(
+        read_pipe(ring, fds[0], res),
+        std::chrono::milliseconds(10)
+    );
+    CHECK(!read);
+    CHECK(res == -ECANCELED);
+    CHECK(std::chrono::steady_clock::now() - start < std::chrono::seconds(1));
+    close(fds[0]);
+    close(fds[1]);
+}
+
+// a worker parked without timeout is woken by the ring's completion
+sqk::Task<void> park_on_cqe(Uring& ring) {
+    int fds[2];
+    int rc = pipe(fds);
+    S_ASSERT(rc == 0);
+    sqk::scheduler->set_idle_policy({
+        .spin_ = 16,
+        .yield_ = 1,
+        .park_timeout_ = std::chrono::nanoseconds(0),
+    });
+    auto parks = sqk::scheduler->stats().parks_;
+    std::jthread writer([fd = fds[1]] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        char byte = 1;
+        auto n = write(fd, &byte, 1);
+        SQK_SET_USED(n);
+    });
+    char byte;
+    CHECK(co_await ring.read(fds[0], &byte, 1, 0) == 1);
+    CHECK(sqk::scheduler->stats().parks_ > parks);
+    sqk::scheduler->set_idle_policy({});
+    close(fds[0]);
+    close(fds[1]);
+}
+
+// one armed accept take every connection
+sqk::Task<void> multishot_accept(Uring& ring) {
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addrlen = sizeof(addr);
+    int rc = bind(listen_fd, (sockaddr*)&addr, addrlen);
+    rc |= listen(listen_fd, 16);
+    rc |= getsockname(listen_fd, (sockaddr*)&addr, &addrlen);
+    S_ASSERT(rc == 0);
+
+    constexpr int conns = 4;
+    UringStream accepted(ring);
+    ring.accept_multishot(listen_fd, accepted);
+    int fds[conns];
+    for (auto& fd : fds) {
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        CHECK(co_await ring.connect(fd, (sockaddr*)&addr, addrlen) == 0);
+    }
+    for (int i = 0; i < conns; i++) {
+        auto cqe = co_await accepted.next();
+        CHECK(cqe && cqe->res_ >= 0 && cqe->more());
+        if (cqe && cqe->res_ >= 0) {
+            close(cqe->res_);
+        }
+    }
+    CHECK(accepted.armed());
+    accepted.cancel();
+    while (auto cqe = co_await accepted.next()) {
+        CHECK(cqe->res_ == -ECANCELED);
+    }
+    CHECK(!accepted.armed());
+    for (auto fd : fds) {
+        close(fd);
+    }
+    close(listen_fd);
+}
+
+// messages land in provided buffers until they run dry, then re-arm
+sqk::Task<void> multishot_recv(Uring& ring) {
+    int fds[2];
+    int rc = socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds);
+    S_ASSERT(rc == 0);
+    constexpr uint16_t entries = 4;
+    BufRing bufs(ring, 1, entries, 64);
+    UringStream received(ring);
+
+    for (uint32_t i = 0; i < entries + 1; i++) {
+        CHECK(write(fds[1], &i, sizeof(i)) == sizeof(i));
+    }
+    ring.recv_multishot(fds[0], bufs, received);
+    uint32_t expect = 0;
+    std::vector<uint16_t> lent;
+    while (auto cqe = co_await received.next()) {
+        if (cqe->res_ == -ENOBUFS) {
+            break;
+        }
+        CHECK(cqe->res_ == sizeof(uint32_t));
+        auto data = bufs.data(*cqe);
+        CHECK(memcmp(data.data(), &expect, sizeof(expect)) == 0);
+        expect++;
+        lent.push_back(cqe->buffer_id());
+    }
+    CHECK(expect == entries);
+    CHECK(!received.armed());
+
+    for (auto bid : lent) {
+        bufs.recycle(bid);
+    }
+    ring.recv_multishot(fds[0], bufs, received);
+    auto cqe = co_await received.next();
+    CHECK(cqe && cqe->res_ == sizeof(uint32_t));
+    if (cqe && cqe->res_ > 0) {
+        CHECK(memcmp(bufs.data(*cqe).data(), &expect, sizeof(expect)) == 0);
+        bufs.recycle(cqe->buffer_id());
+    }
+    close(fds[1]);
+    while (auto cqe = co_await received.next()) {
+        CHECK(cqe->res_ == 0);
+    }
+    close(fds[0]);
+}
+
+// a SQPOLL ring, submitted by its kernel thread
+sqk::Task<void> sqpoll() {
+    Uring ring({.sqpoll_ = true, .sq_idle_ms_ = 10});
+    sqk::scheduler->add_poller(ring);
+    co_await pipe_rw(ring);
+    sqk::scheduler->remove_poller(&ring);
+    // resumed from the ring's own poll, leave it before destroying it
+    co_yield nullptr;
+}
+
+int main(int argc, char* argv[]) {
+    S_LOGGER_SETUP;
+    return sqk::test::run("uring", []() -> sqk::Task<void> {
+        auto& ring = Uring::local();
+        co_await pipe_rw(ring);
+        co_await tcp(ring);
+        co_await timeout(ring);
+        co_await read_timeout(ring);
+        co_await park_on_cqe(ring);
+        co_await multishot_accept(ring);
+        co_await multishot_recv(ring);
+        co_await sqpoll();
+    });
+}
@@ -0,0 +1,106 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <vector>
+
+#include "stream_util.hpp"
+using namespace sqk::net;
+using sqk::test::read_full;
+using sqk::test::write_full;
+
+constexpr uint64_t requests = 1 << 18;
+
+uint32_t payload = 64;
+uint32_t connections = 64;
+
+sqk::Task<void> echo(TcpStream stream) {
+    std::vector<uint8_t> buf(payload);
+    int n;
+    while ((n = co_await stream.read(buf.data(), payload)) > 0) {
+        if (!co_await write_full(stream, buf.data(), n)) {
+            break;
+        }
+    }
+}
+
+sqk::Task<void> server(TcpListener& listener) {
+    for (uint32_t i = 0; i < connections; i++) {
+        auto stream = co_await listener.accept();
+        stream.set_nodelay();
+        sqk::scheduler->enqueue(echo(std::move(stream)));
+    }
+}
+
+// request/response round trips, recording the latency of each in ns
+sqk::Task<void> client(
+    InetAddr addr,
+    uint32_t id,
+    std::vector<uint32_t>& latencies,
+    std::atomic<uint64_t>& remaining
+) {
+    auto stream = co_await TcpStream::connect(addr);
+    stream.set_nodelay();
+    std::vector<uint8_t> out(payload, id), in(payload);
+    for (uint64_t i = id; i < requests; i += connections) {
+        auto start = std::chrono::steady_clock::now();
+        bool ok = co_await write_full(stream, out.data(), payload);
+        ok = ok && co_await read_full(stream, in.data(), payload);
+        S_ASSERT(ok);
+        SQK_SET_USED(ok);
+        std::chrono::nanoseconds latency =
+            std::chrono::steady_clock::now() - start;
+        latencies[i] = latency.count();
+        remaining--;
+    }
+}
+
+/**
+ * usage: echo_bench [connections] [payload] [workers], the server on the
+ * first worker and the clients on the last, 2 workers by default
+ */
+int main(int argc, char* argv[]) {
+    S_LOGGER_SETUP;
+    if (argc > 1) {
+        connections = atoi(argv[1]);
+    }
+    if (argc > 2) {
+        payload = atoi(argv[2]);
+    }
+    uint32_t workers = argc > 3 ? atoi(argv[3]) : 2;
+    sqk::SQKSchedulerGroup group(workers);
+    auto listener = TcpListener::bind(InetAddr("127.0.0.1", 0));
+    InetAddr addr("127.0.0.1", listener.local_addr().port());
+    std::vector<uint32_t> latencies(requests);
+    std::atomic<uint64_t> remaining = requests;
+
+    auto bench = [&]() -> sqk::Task<void> {
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t id = 0; id < connections; id++) {
+            group.spawn_on(
+                group.size() - 1,
+                client(addr, id, latencies, remaining)
+            );
+        }
+        while (remaining) {
+            co_yield nullptr;
+        }
+        std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+        std::sort(latencies.begin(), latencies.end());
+        S_INFO(
+            "echo {} connections, {}B: {:.0f} req/s, p50 {:.1f}us, p99 {:.1f}us",
+            connections,
+            payload,
+            requests / elapsed.count(),
+            latencies[requests / 2] / 1000.,
+            latencies[requests * 99 / 100] / 1000.
+        );
+        group.stop();
+    };
+    group.spawn_on(0, server(listener));
+    group.spawn_on(0, bench());
+    group.start();
+    group.join();
+    return 0;
+}
@@ -0,0 +1,105 @@
+#include <cstring>
+#include <vector>
+
+#include "stream_util.hpp"
+#include "test_util.hpp"
+using namespace sqk::net;
+using sqk::test::read_full;
+using sqk::test::write_full;
+
+sqk::Task<void> echo(TcpStream stream) {
+    uint8_t buf[4096];
+    int n;
+    while ((n = co_await stream.read(buf, sizeof(buf))) > 0) {
+        if (!co_await write_full(stream, buf, n)) {
+            break;
+        }
+    }
+}
+
+sqk::Task<void> server(TcpListener& listener) {
+    auto stream = co_await listener.accept();
+    co_await echo(std::move(stream));
+}
+
+// a small message then one large enough to be sent zero copy
+sqk::Task<void> tcp_echo() {
+    auto listener = TcpListener::bind(InetAddr("127.0.0.1", 0));
+    sqk::scheduler->enqueue(server(listener));
+    auto stream = co_await TcpStream::connect(
+        InetAddr("127.0.0.1", listener.local_addr().port())
+    );
+    stream.set_nodelay();
+
+    for (uint32_t len : {64U, 256U << 10}) {
+        std::vector<uint8_t> out(len), in(len);
+        for (uint32_t i = 0; i < len; i++) {
+            out[i] = i * 7;
+        }
+        CHECK(co_await write_full(stream, out.data(), len));
+        CHECK(co_await read_full(stream, in.data(), len));
+        CHECK(in == out);
+    }
+    stream.shutdown();
+    uint8_t byte;
+    CHECK(co_await stream.read(&byte, 1) == 0);
+}
+
+sqk::Task<void> connect_refused() {
+    // a free port nobody listen on
+    auto port = UdpSocket::bind(InetAddr("127.0.0.1", 0)).local_addr().port();
+    bool refused = false;
+    try {
+        co_await TcpStream::connect(InetAddr("127.0.0.1", port));
+    } catch (std::system_error& e) {
+        refused = e.code().value() == ECONNREFUSED;
+    }
+    CHECK(refused);
+}
+
+// connections taken from one multishot accept
+sqk::Task<void> tcp_incoming() {
+    auto listener = TcpListener::bind(InetAddr("127.0.0.1", 0));
+    InetAddr addr("127.0.0.1", listener.local_addr().port());
+    UringStream accepted(Uring::local());
+    listener.incoming(accepted);
+    std::vector<TcpStream> clients;
+    for (int i = 0; i < 3; i++) {
+        clients.push_back(co_await TcpStream::connect(addr));
+        auto cqe = co_await accepted.next();
+        CHECK(cqe && cqe->res_ >= 0);
+        if (cqe && cqe->res_ >= 0) {
+            sqk::scheduler->enqueue(echo(TcpStream(cqe->res_)));
+        }
+    }
+    for (auto& client : clients) {
+        uint8_t out[] = "sqk", in[sizeof(out)];
+        CHECK(co_await write_full(client, out, sizeof(out)));
+        CHECK(co_await read_full(client, in, sizeof(in)));
+        CHECK(memcmp(in, out, sizeof(out)) == 0);
+    }
+    accepted.cancel();
+    while (co_await accepted.next()) {}
+}
+
+sqk::Task<void> udp() {
+    auto a = UdpSocket::bind(InetAddr("127.0.0.1", 0));
+    auto b = UdpSocket::bind(InetAddr("127.0.0.1", 0));
+    auto to = b.local_addr();
+    char out[] = "datagram", in[64];
+    CHECK(co_await a.send_to(out, sizeof(out), to) == sizeof(out));
+    InetAddr from;
+    CHECK(co_await b.recv_from(in, sizeof(in), from) == sizeof(out));
+    CHECK(memcmp(in, out, sizeof(out)) == 0);
+    CHECK(from.port() == a.local_addr().port());
+}
+
+int main(int argc, char* argv[]) {
+    S_LOGGER_SETUP;
+    return sqk::test::run("socket", []() -> sqk::Task<void> {
+        co_await tcp_echo();
+        co_await connect_refused();
+        co_await tcp_incoming();
+        co_await udp();
+    });
+}
@@ -0,0 +1,37 @@
+#ifndef SQK_TESTS_SOCKET_STREAM_UTIL_HPP_
+#define SQK_TESTS_SOCKET_STREAM_UTIL_HPP_
+
+#include "socket.hpp"
+
+namespace sqk::test {
+using net::TcpStream;
+
+/* read exactly `len` bytes, false on EOF or error */
+inline Task<bool> read_full(TcpStream& stream, uint8_t* buf, uint32_t len) {
+    while (len) {
+        int n = co_await stream.read(buf, len);
+        if (n <= 0) {
+            co_return false;
+        }
+        buf += n;
+        len -= n;
+    }
+    co_return true;
+}
+
+inline Task<bool>
+write_full(TcpStream& stream, const uint8_t* buf, uint32_t len) {
+    while (len) {
+        int n = co_await stream.write(buf, len);
+        if (n <= 0) {
+            co_return false;
+        }
+        buf += n;
+        len -= n;
+    }
+    co_return true;
+}
+
+} // namespace sqk::test
+
+#endif // !SQK_TESTS_SOCKET_STREAM_UTIL_HPP_